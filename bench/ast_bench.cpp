@@ -0,0 +1,294 @@
+// Parse and teardown time of the flat node table against the previous
+// unique_ptr tree.
+//
+//   make bench/ast_bench.out && ./bench/ast_bench.out [depth] [rounds]
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * The unique_ptr tree and parser as they were before the node table, kept
+ * here as the baseline
+ */
+namespace uptr {
+
+class Expression {
+  public:
+    virtual ~Expression(){};
+};
+
+class Binary : public Expression {
+  public:
+    std::unique_ptr<Expression> left;
+    Token oprt;
+    std::unique_ptr<Expression> right;
+    Binary(std::unique_ptr<Expression> left, Token oprt,
+           std::unique_ptr<Expression> right)
+        : left(std::move(left)), oprt(oprt), right(std::move(right)) {}
+};
+
+class Grouping : public Expression {
+  public:
+    std::unique_ptr<Expression> inner_expr;
+    Grouping(std::unique_ptr<Expression> inner_expr)
+        : inner_expr(std::move(inner_expr)) {}
+};
+
+enum LiteralType { LT_NUMBER, LT_STRING, LT_BOOLEAN, LT_NIL };
+
+class Literal : public Expression {
+  public:
+    int number;
+    std::string str;
+    bool boolean;
+    LiteralType literal_type;
+    Literal(LiteralType literal_type, int number)
+        : number(number), literal_type(literal_type) {}
+    Literal(LiteralType literal_type, std::string str)
+        : str(str), literal_type(literal_type) {}
+    Literal(LiteralType literal_type, bool boolean)
+        : boolean(boolean), literal_type(literal_type) {}
+};
+
+class Unary : public Expression {
+  public:
+    Token oprt;
+    std::unique_ptr<Expression> right;
+    Unary(Token oprt, std::unique_ptr<Expression> right)
+        : oprt(oprt), right(std::move(right)) {}
+};
+
+struct Parser {
+    TokenCursor *tokens;
+    std::unique_ptr<Expression> expression();
+};
+
+bool at_the_end(Parser *p) { return p->tokens->peek().type == END_OF_FILE; }
+
+Token previous(Parser *p) { return p->tokens->previous(); }
+
+void advance(Parser *p) {
+    if (!at_the_end(p)) {
+        p->tokens->next();
+    }
+}
+
+bool same_type_as_curr_token(Parser *p, TokenType type) {
+    if (at_the_end(p)) {
+        return false;
+    }
+
+    return type == p->tokens->peek().type;
+}
+
+bool match(Parser *p, std::vector<TokenType> v) {
+    for (unsigned long i = 0; i < v.size(); i++) {
+        if (same_type_as_curr_token(p, v.at(i))) {
+                        advance(p);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void consume(Parser *p, TokenType type, std::string error_message) {
+    if (same_type_as_curr_token(p, type)) {
+        advance(p);
+    } else {
+        throw std::runtime_error(error_message);
+    }
+}
+
+
+std::unique_ptr<Expression> primary(Parser *p) {
+    std::vector<TokenType> types{FALSE};
+    if (match(p, types)) {
+        return std::unique_ptr<Literal>(new Literal(LT_BOOLEAN, false));
+    }
+
+    types.at(0) = TRUE;
+    if (match(p, types)) {
+        return std::unique_ptr<Literal>(new Literal(LT_BOOLEAN, true));
+    }
+
+    types.at(0) = _NULL;
+    if (match(p, types)) {
+        return std::unique_ptr<Literal>(new Literal(LT_NIL, true));
+    }
+
+    types.at(0) = NUMBER;
+    if (match(p, types)) {
+        return std::unique_ptr<Literal>(
+            new Literal(LT_NUMBER, std::stoi(std::string(previous(p).text))));
+    }
+
+    types.at(0) = STRING;
+    if (match(p, types)) {
+        return std::unique_ptr<Literal>(
+            new Literal(LT_STRING, std::string(previous(p).text)));
+    }
+
+    types.at(0) = LEFT_PAREN;
+    if (match(p, types)) {
+        auto expr = p->expression();
+        consume(p, RIGHT_PAREN, "Expected ')' after '('");
+        return std::unique_ptr<Grouping>(new Grouping(std::move(expr)));
+    }
+
+    throw std::runtime_error(
+        "Parser error unhandled type in Expression.primary()");
+}
+
+std::unique_ptr<Expression> unary(Parser *p) {
+    std::vector<TokenType> types{BANG, MINUS};
+    if (match(p, types)) {
+        Token oprt = previous(p);
+        auto right = unary(p);
+        return std::unique_ptr<Unary>(new Unary(oprt, std::move(right)));
+    }
+
+    return primary(p);
+}
+
+std::unique_ptr<Expression> multiplication(Parser *p) {
+    auto left = unary(p);
+
+    std::vector<TokenType> types{SLASH, STAR};
+    while (match(p, types)) {
+        Token oprt = previous(p);
+        auto right = unary(p);
+        left = std::unique_ptr<Binary>(
+            new Binary(std::move(left), oprt, std::move(right)));
+    }
+
+    return left;
+}
+
+std::unique_ptr<Expression> addition(Parser *p) {
+    auto left = multiplication(p);
+
+    std::vector<TokenType> types{MINUS, PLUS};
+    while (match(p, types)) {
+        Token oprt = previous(p);
+        auto right = multiplication(p);
+        left = std::unique_ptr<Binary>(
+            new Binary(std::move(left), oprt, std::move(right)));
+    }
+
+    return left;
+}
+
+std::unique_ptr<Expression> comparison(Parser *p) {
+    auto left = addition(p);
+
+    std::vector<TokenType> types{GREATER, GREATER_EQUAL, LESS, LESS_EQUAL};
+    while (match(p, types)) {
+        Token oprt = previous(p);
+        auto right = addition(p);
+        left = std::unique_ptr<Binary>(
+            new Binary(std::move(left), oprt, std::move(right)));
+    }
+
+    return left;
+}
+
+std::unique_ptr<Expression> equality(Parser *p) {
+    auto left = comparison(p);
+    std::vector<TokenType> types{EQUAL_EQUAL, BANG_EQUAL};
+    while (match(p, types)) {
+        Token oprt = previous(p);
+        auto right = comparison(p);
+        left = std::unique_ptr<Binary>(
+            new Binary(std::move(left), oprt, std::move(right)));
+    }
+    return left;
+}
+
+std::unique_ptr<Expression> Parser::expression() { return equality(this); }
+
+
+} // namespace uptr
+
+// Balanced tree of groupings, 2^depth number literals. The unique_ptr tree
+// is torn down recursively, so the input must not be one long chain.
+static void generate(std::string &out, int depth, int &counter) {
+    static const char *ops[] = {" + ", " * ", " - ", " < ", " == "};
+    if (depth == 0) {
+        if (counter % 3 == 0) {
+            out += "-";
+        }
+        out += std::to_string(counter++ % 1000);
+        return;
+    }
+    out += "(";
+    generate(out, depth - 1, counter);
+    out += ops[(depth + counter) % 5];
+    generate(out, depth - 1, counter);
+    out += ")";
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double ms_since(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+}
+
+int main(int argc, char const *argv[]) {
+    int depth = argc > 1 ? std::stoi(argv[1]) : 18;
+    int rounds = argc > 2 ? std::stoi(argv[2]) : 10;
+
+    std::string source;
+    int counter = 0;
+    generate(source, depth, counter);
+
+    Interner interner;
+    TokenStream tokens = lex(source, interner);
+    std::cout << "input: " << source.size() << " bytes, " << tokens.size()
+              << " tokens, " << rounds << " rounds" << std::endl;
+
+    double flat_parse = 0, flat_free = 0, flat_bytes = 0;
+    double uptr_parse = 0, uptr_free = 0;
+    for (int round = 0; round < rounds; round++) {
+        {
+            StreamSource stream(tokens);
+            auto start = Clock::now();
+            std::unique_ptr<Ast> ast(new Ast());
+            Parser parser;
+            parser.parse(stream, *ast);
+            flat_parse += ms_since(start);
+            flat_bytes = ast->nodes.size() * sizeof(Node) +
+                         ast->extra.size() * sizeof(uint32_t);
+
+            start = Clock::now();
+            ast.reset();
+            flat_free += ms_since(start);
+        }
+        {
+            StreamSource stream(tokens);
+            TokenCursor cursor(stream);
+            auto start = Clock::now();
+            uptr::Parser parser = {&cursor};
+            auto ast = parser.expression();
+            uptr_parse += ms_since(start);
+
+            start = Clock::now();
+            ast.reset();
+            uptr_free += ms_since(start);
+        }
+    }
+
+    std::cout << "node table: parse " << flat_parse / rounds << " ms, teardown "
+              << flat_free / rounds << " ms, " << flat_bytes / 1024
+              << " KiB of nodes" << std::endl;
+    std::cout << "unique_ptr: parse " << uptr_parse / rounds << " ms, teardown "
+              << uptr_free / rounds << " ms" << std::endl;
+    return 0;
+}
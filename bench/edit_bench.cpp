@@ -0,0 +1,95 @@
+// Incremental re-lex and re-parse after small edits against lexing and
+// parsing the edited text from scratch. Every edit swaps one literal of a
+// balanced expression for another expression; the document is compared
+// with a fresh parse of its text after each of the checked edits.
+//
+//   make bench/edit_bench.out && ./bench/edit_bench.out [leaves] [edits]
+
+#include "document.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+
+typedef std::chrono::steady_clock Clock;
+
+static void balanced(std::string &out, long leaves, std::mt19937 &random) {
+    if (leaves == 1) {
+        out += std::to_string(random() % 1000);
+        return;
+    }
+    static const char *const ops[] = {" + ", " - ", " * ", " < ", " == "};
+    out += '(';
+    balanced(out, leaves / 2, random);
+    out += ops[random() % 5];
+    balanced(out, leaves - leaves / 2, random);
+    out += ')';
+}
+
+int main(int argc, char const *argv[]) {
+    long leaves = argc > 1 ? std::stol(argv[1]) : 200000;
+    int edits = argc > 2 ? std::stoi(argv[2]) : 200;
+
+    std::mt19937 random(42);
+    std::string source;
+    balanced(source, leaves, random);
+
+    auto start = Clock::now();
+    Document document(source);
+    double full = std::chrono::duration<double>(Clock::now() - start).count();
+
+    static const char *const replacements[] = {"7", "(1 + 2)", "-3",
+                                               "4 * 5 - 6", "\"s\""};
+    double incremental = 0;
+    size_t relexed = 0;
+    size_t reparsed = 0;
+    int full_parses = 0;
+    for (int i = 0; i < edits; i++) {
+        // Literal under a random offset
+        const std::string &text = document.text();
+        uint64_t offset = random() % text.size();
+        while (offset < text.size() && !isdigit(text[offset])) {
+            offset++;
+        }
+        if (offset == text.size()) {
+            continue;
+        }
+        while (offset > 0 && isdigit(text[offset - 1])) {
+            offset--;
+        }
+        uint64_t end = offset;
+        while (end < text.size() && isdigit(text[end])) {
+            end++;
+        }
+
+        start = Clock::now();
+        EditStats stats = document.edit(offset, end - offset,
+                                        replacements[random() % 5]);
+        incremental +=
+            std::chrono::duration<double>(Clock::now() - start).count();
+        relexed += stats.tokens_relexed;
+        reparsed += stats.nodes_reparsed;
+        full_parses += stats.full_parse;
+
+        if (i % 50 == 0 || i == edits - 1) {
+            Document fresh(document.text());
+            if (!document.matches(fresh)) {
+                std::cerr << "edit " << i << " differs from a full parse"
+                          << std::endl;
+                return 1;
+            }
+        }
+    }
+    incremental /= edits;
+
+    std::cout << source.size() << " bytes, " << document.tokens().size()
+              << " tokens, " << document.ast().nodes.size() << " nodes"
+              << std::endl;
+    std::cout << "full:        " << full * 1000 << " ms" << std::endl;
+    std::cout << "incremental: " << incremental * 1000 << " ms per edit, "
+              << double(relexed) / edits << " tokens relexed, "
+              << double(reparsed) / edits << " nodes reparsed, "
+              << full_parses << " full parses, " << full / incremental
+              << "x faster" << std::endl;
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Checks that lex_parallel() produces exactly what lex() does, then times
+// both on a large source for growing chunk counts.
+//
+//   make bench/lex_bench.out && ./bench/lex_bench.out [MB] [cases]
+//
+// The check compares tokens, interned ids, reported errors and whether
+// lexing failed, on random sources built to put chunk boundaries next to
+// multi-line strings, comments holding quotes and strings holding "//".
+// With 0 MB only the check runs, which make test does on a few hundred
+// sources.
+
+#include "lexer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+static const char *const pieces[] = {
+    "foo",  "bar1", " ",    "\n",   "  \n", "\r\n", "123",   "4.5",
+    "12.",  "+",    "-",    "/",    "//",   "==",   "!=",    "<=",
+    "(",    ")",    "\"",   "\"a\nb\"",  "\"x // y\"", "// \"q\n",
+    "if",   "nil",  "\t",   "7",    "/ /",  "\"\"",
+};
+static const char *const invalid[] = {"$", "@", "#", "~"};
+
+static std::string random_source(std::mt19937 &random, size_t pieces_count,
+                                 bool errors) {
+    std::string out;
+    for (size_t i = 0; i < pieces_count; i++) {
+        if (errors && random() % 200 == 0) {
+            out += invalid[random() % 4];
+        } else {
+            out += pieces[random() % (sizeof(pieces) / sizeof(*pieces))];
+        }
+    }
+    return out;
+}
+
+struct Lexed {
+    TokenStream tokens;
+    std::vector<std::string> strings; // interned, in id order
+    std::string errors;
+    std::vector<LexerError> error_list;
+    bool failed = false;
+};
+
+static Lexed run(std::string_view source, unsigned chunks) {
+    Lexed lexed;
+    Interner interner;
+    interner.intern("bar1"); // ids continue from a used interner
+    std::ostringstream errors;
+    // Failing leaves the tokens around the errors, which are compared too
+    lexed.tokens =
+        chunks == 0
+            ? lex(source, interner, errors, &lexed.error_list, &lexed.failed)
+            : lex_parallel(source, interner, errors, chunks,
+                           &lexed.error_list, &lexed.failed);
+    for (uint32_t id = 1; id <= interner.size(); id++) {
+        lexed.strings.emplace_back(interner.text(id));
+    }
+    lexed.errors = errors.str();
+    return lexed;
+}
+
+static bool same(const Lexed &a, const Lexed &b) {
+    bool same_errors =
+        a.error_list.size() == b.error_list.size() &&
+        std::equal(a.error_list.begin(), a.error_list.end(),
+                   b.error_list.begin(), [](LexerError x, LexerError y) {
+                       return x.line == y.line && x.column == y.column;
+                   });
+    return a.tokens.types == b.tokens.types &&
+           a.tokens.offsets == b.tokens.offsets &&
+           a.tokens.lengths == b.tokens.lengths &&
+           a.tokens.ids == b.tokens.ids && a.strings == b.strings &&
+           a.errors == b.errors && same_errors && a.failed == b.failed;
+}
+
+// Tokens of every kind over many short lines, with some comments and
+// strings spanning lines
+static std::string large_source(size_t size) {
+    std::mt19937 random(7);
+    std::string out;
+    while (out.size() < size) {
+        out += random_source(random, 40, false);
+        out += '\n';
+    }
+    return out;
+}
+
+int main(int argc, char const *argv[]) {
+    size_t size = size_t((argc > 1 ? std::stod(argv[1]) : 16) * (1 << 20));
+    int cases = argc > 2 ? std::stoi(argv[2]) : 2000;
+
+    std::mt19937 random(1);
+    int mismatches = 0;
+    for (int i = 0; i < cases; i++) {
+        std::string source =
+            random_source(random, 1 + random() % 400, i % 3 == 0);
+        Lexed serial = run(source, 0);
+        for (unsigned chunks : {1u, 2u, 3u, 5u, 8u, 13u, 40u}) {
+            if (!same(serial, run(source, chunks))) {
+                std::cerr << "mismatch with " << chunks << " chunks on:\n"
+                          << source << std::endl;
+                mismatches++;
+            }
+        }
+    }
+    if (mismatches > 0) {
+        std::cerr << mismatches << " mismatches" << std::endl;
+        return 1;
+    }
+    std::cout << cases << " random sources lex the same with 1 to 40 chunks"
+              << std::endl;
+    if (size == 0) {
+        return 0;
+    }
+
+    std::string source = large_source(size);
+    Lexed serial = run(source, 0);
+    auto time = [&](unsigned chunks) {
+        double best = 0;
+        for (int round = 0; round < 3; round++) {
+            auto start = Clock::now();
+            Lexed lexed = run(source, chunks);
+            double seconds =
+                std::chrono::duration<double>(Clock::now() - start).count();
+            if (!same(serial, lexed)) {
+                std::cerr << "mismatch with " << chunks << " chunks"
+                          << std::endl;
+                exit(1);
+            }
+            best = round == 0 ? seconds : std::min(best, seconds);
+        }
+        return best;
+    };
+
+    double base = time(0);
+    std::cout << source.size() / 1e6 << " MB, " << serial.tokens.size()
+              << " tokens, " << std::thread::hardware_concurrency()
+              << " hardware threads" << std::endl;
+    std::cout << "serial     " << base * 1000 << " ms" << std::endl;
+    for (unsigned chunks = 2; chunks <= 64; chunks *= 2) {
+        double seconds = time(chunks);
+        std::cout << chunks << " chunks" << std::string(chunks < 10 ? 4 : 3, ' ')
+                  << seconds * 1000 << " ms, " << base / seconds << "x"
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Compiles the golden tests in-process through libko, checks the outputs
+// against the .exp files the way test_runner.sh does, then reports how
+// many compiles per second one thread sustains. Linked against libko.a
+// alone, so it also checks that the library stands on its own.
+//
+//   make bench/library_bench.out
+//   ./bench/library_bench.out [rounds]
+
+#include "libko.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+using ko::Diagnostic;
+using ko::Options;
+using ko::Result;
+
+struct Case {
+    std::string name;
+    std::string source;
+    std::string expected;
+    Options options;
+};
+
+static std::string read_file(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+// Test directories whose tests are one compile of the .ko file. The rest
+// run several commands or other programs.
+static const std::set<std::string> compile_dirs = {
+    "asm", "bytecode", "fold", "ir", "jit", "parallel_lexer", "parser", "vm",
+    "x86_64"};
+
+// The flags test_runner.sh passes for a test directory
+static Options directory_options(const std::string &dir) {
+    Options options;
+    bool parser = dir == "parser" || dir == "parallel_lexer";
+    options.fold = parser || dir == "fold" || dir == "ir";
+    options.output_assembly = dir == "asm" || dir == "x86_64";
+    options.print_parser = parser;
+    options.print_folded = dir == "fold";
+    options.print_ir = dir == "ir";
+    options.print_bytecode = dir == "bytecode";
+    options.run = dir == "vm";
+    options.jit = dir == "jit";
+    if (dir == "parallel_lexer") {
+        options.lex_threads = 4;
+    }
+    if (dir == "x86_64") {
+        options.target = "x86_64-linux";
+    }
+    return options;
+}
+
+// What run.out would print, exit status included where the runner echoes it
+static std::string output(const Result &result, const Options &options) {
+    std::string out = result.ast + result.folded + result.bytecode +
+                      result.ir + result.assembly;
+    for (const Diagnostic &diagnostic : result.diagnostics) {
+        out += diagnostic.message + '\n';
+    }
+    if (options.run || options.jit) {
+        out += std::to_string(result.status & 0xff) + '\n';
+    }
+    return out;
+}
+
+static std::string strip_newlines(std::string text) {
+    text.erase(std::remove(text.begin(), text.end(), '\n'), text.end());
+    return text;
+}
+
+int main(int argc, char const *argv[]) {
+    int rounds = argc > 1 ? std::stoi(argv[1]) : 200;
+
+    std::vector<Case> cases;
+    for (const auto &dir : std::filesystem::directory_iterator("test")) {
+        if (!dir.is_directory() ||
+            !compile_dirs.count(dir.path().filename().string())) {
+            continue;
+        }
+        for (const auto &file : std::filesystem::directory_iterator(dir)) {
+            std::filesystem::path expected = file.path();
+            expected.replace_extension(".exp");
+            if (file.path().extension() != ".ko" ||
+                !std::filesystem::exists(expected)) {
+                continue;
+            }
+            cases.push_back({file.path().string(), read_file(file.path()),
+                             read_file(expected),
+                             directory_options(dir.path().filename())});
+        }
+    }
+    if (cases.empty()) {
+        std::cerr << "No tests found, run from the repository root"
+                  << std::endl;
+        return 1;
+    }
+
+    int failed = 0;
+    for (const Case &test : cases) {
+        Result result = ko::compile(test.source, test.options);
+        if (strip_newlines(output(result, test.options)) !=
+            strip_newlines(test.expected)) {
+            std::cerr << "FAIL " << test.name << std::endl;
+            failed++;
+        }
+    }
+
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (const Case &test : cases) {
+            ko::compile(test.source, test.options);
+        }
+    }
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    size_t compiles = size_t(rounds) * cases.size();
+
+    std::cout << cases.size() - failed << " of " << cases.size()
+              << " tests match their .exp files" << std::endl;
+    std::cout << compiles << " compiles in " << seconds * 1000 << " ms, "
+              << compiles / seconds << " per second" << std::endl;
+    return failed > 0;
+}
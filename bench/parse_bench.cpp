@@ -0,0 +1,69 @@
+// Parse throughput on long flat expressions, lexing excluded.
+//
+//   make bench/parse_bench.out && ./bench/parse_bench.out [terms] [rounds]
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+
+typedef std::chrono::steady_clock Clock;
+
+struct Corpus {
+    const char *name;
+    std::string source;
+};
+
+// One binary operator between every pair of operands, no nesting
+static std::string flat_chain(long terms, const char *const *ops,
+                              int op_count) {
+    std::string out;
+    for (long i = 0; i < terms; i++) {
+        if (i > 0) {
+            out += ops[i % op_count];
+        }
+        if (i % 7 == 3) {
+            out += "-";
+        }
+        out += std::to_string(i % 1000);
+    }
+    return out;
+}
+
+int main(int argc, char const *argv[]) {
+    long terms = argc > 1 ? std::stol(argv[1]) : 1000000;
+    int rounds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    static const char *const additive[] = {" + ", " - "};
+    static const char *const mixed[] = {" + ", " * ", " - ", " / ",
+                                        " < ", " == ", " >= ", " != "};
+    Corpus corpora[] = {
+        {"additive", flat_chain(terms, additive, 2)},
+        {"mixed", flat_chain(terms, mixed, 8)},
+    };
+
+    for (const Corpus &corpus : corpora) {
+        Interner interner;
+        TokenStream tokens = lex(corpus.source, interner);
+
+        double seconds = 0;
+        for (int round = 0; round < rounds; round++) {
+            StreamSource stream(tokens);
+            Ast ast;
+            Parser parser;
+            auto start = Clock::now();
+            parser.parse(stream, ast);
+            seconds +=
+                std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        seconds /= rounds;
+
+        std::cout << corpus.name << ": " << tokens.size() << " tokens, "
+                  << seconds * 1000 << " ms, "
+                  << corpus.source.size() / seconds / 1e6 << " MB/s, "
+                  << tokens.size() / seconds / 1e6 << " Mtokens/s"
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+// Requests per second of a warm server against starting run.out for every
+// compile. Checks that both produce the same assembly.
+//
+//   make run.out bench/serve_bench.out
+//   ./run.out --serve /tmp/ko.sock &
+//   ./bench/serve_bench.out /tmp/ko.sock code.ko [requests] [clients]
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <spawn.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static void append_u32(std::string &out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out += char(value >> (8 * i));
+    }
+}
+
+static uint32_t load_u32(const char *bytes) {
+    const unsigned char *b = reinterpret_cast<const unsigned char *>(bytes);
+    return b[0] | b[1] << 8 | b[2] << 16 | uint32_t(b[3]) << 24;
+}
+
+static void read_exact(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = read(fd, data, size);
+        if (n <= 0) {
+            throw std::runtime_error("connection closed");
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+static int connect_to(const char *path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address),
+                sizeof(address)) < 0) {
+        throw std::runtime_error(std::string("cannot connect to ") + path);
+    }
+    return fd;
+}
+
+// Sends one request and returns the output of the compile
+static std::string compile(int fd, const std::string &request) {
+    if (write(fd, request.data(), request.size()) != ssize_t(request.size())) {
+        throw std::runtime_error("short write");
+    }
+    char header[12];
+    read_exact(fd, header, 12);
+    std::string response(load_u32(header) - 8, '\0');
+    read_exact(fd, &response[0], response.size());
+    if (load_u32(header + 4) != 0) {
+        throw std::runtime_error("compile failed: " + response);
+    }
+    return response.substr(0, load_u32(header + 8));
+}
+
+// Output of run.out started as a process
+static std::string spawn_compile(const char *input) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        throw std::runtime_error("pipe failed");
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, pipe_fds[0]);
+    const char *argv[] = {"./run.out", input, nullptr};
+    pid_t pid;
+    if (posix_spawn(&pid, argv[0], &actions, nullptr,
+                    const_cast<char *const *>(argv), environ) != 0) {
+        throw std::runtime_error("cannot start ./run.out");
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]);
+    std::string out;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(pipe_fds[0], buffer, sizeof(buffer))) > 0) {
+        out.append(buffer, n);
+    }
+    close(pipe_fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return out;
+}
+
+int main(int argc, char const *argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0]
+                  << " socket code.ko [requests] [clients]" << std::endl;
+        return 1;
+    }
+    const char *socket_path = argv[1];
+    const char *input = argv[2];
+    int requests = argc > 3 ? std::stoi(argv[3]) : 2000;
+    int clients = argc > 4 ? std::stoi(argv[4]) : 4;
+
+    std::string payload = std::string(input) + '\0' + '\0';
+    std::string request;
+    append_u32(request, payload.size());
+    request += payload;
+
+    try {
+        std::string expected = spawn_compile(input);
+        auto start = Clock::now();
+        int spawned = std::max(requests / 10, 1);
+        for (int i = 0; i < spawned; i++) {
+            spawn_compile(input);
+        }
+        double process =
+            std::chrono::duration<double>(Clock::now() - start).count() /
+            spawned;
+
+        std::vector<std::thread> threads;
+        std::vector<int> mismatches(clients);
+        start = Clock::now();
+        for (int c = 0; c < clients; c++) {
+            threads.emplace_back([&, c] {
+                int fd = connect_to(socket_path);
+                for (int i = c; i < requests; i += clients) {
+                    mismatches[c] += compile(fd, request) != expected;
+                }
+                close(fd);
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        double served =
+            std::chrono::duration<double>(Clock::now() - start).count() /
+            requests;
+
+        for (int count : mismatches) {
+            if (count > 0) {
+                std::cerr << "server output differs from run.out" << std::endl;
+                return 1;
+            }
+        }
+        std::cout << "process: " << process * 1e6 << " us per compile"
+                  << std::endl;
+        std::cout << "server:  " << served * 1e6 << " us per compile, "
+                  << clients << " clients, " << process / served
+                  << "x faster" << std::endl;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
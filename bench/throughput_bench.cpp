@@ -0,0 +1,532 @@
+// Lex, parse and code generation throughput on generated corpora, compared
+// with a stored baseline. Run through make:
+//
+//   make bench            measure and flag regressions against the baseline
+//   make bench-baseline   measure and store the results as the new baseline
+//
+// or directly:
+//
+//   ./bench/throughput_bench.out [--baseline=file] [--save=file]
+//       [--corpus-dir=dir] [--size=MB] [--rounds=N] [--tolerance=percent]
+//
+// --corpus-dir writes the generated sources as .ko files, e.g. to look at
+// them with run.out --time-phases. Each phase is timed on its own, median
+// of the rounds, and reported per source byte and per token along with its
+// noise, how far the rounds stray from the median. Corpora that the parser
+// or the code generator does not accept are only measured up to the phase
+// before.
+//
+// A rate regresses when it drops below the baseline by more than the
+// tolerance, or by more than three times the noise of the two together
+// when that is larger. A corpus with such a rate is measured once more,
+// and only rates that stay below count.
+
+#include "backend.hpp"
+#include "ir/passes.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <pthread.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+typedef std::map<std::string, std::map<std::string, double>> Results;
+
+struct Settings {
+    std::string baseline;
+    std::string save;
+    std::string corpus_dir;
+    size_t size = 4 << 20;
+    int rounds = 7;
+    double tolerance = 0.25;
+};
+
+/*
+ * Corpora
+ */
+
+static const char *const keywords[] = {"if",     "while", "return", "int",
+                                       "struct", "true",  "false",  "nil"};
+static const char *const operators[] = {"+",  "-",  "*", "/",  "<",  "<=",
+                                        ">",  ">=", "==", "!=", "!", "=",
+                                        "(",  ")",  "{", "}",  ",",  ";"};
+static const char *const binary[] = {" + ", " - ", " * ", " / ",
+                                     " < ", " == ", " >= ", " != "};
+
+static std::string word(std::mt19937 &random, int max_length) {
+    std::string out;
+    int length = 1 + random() % max_length;
+    for (int i = 0; i < length; i++) {
+        out += char('a' + random() % 26);
+    }
+    return out;
+}
+
+// Every kind of token in random order, not meant to parse
+static std::string token_soup(size_t size, std::mt19937 &random) {
+    std::string out;
+    while (out.size() < size) {
+        switch (random() % 6) {
+        case 0:
+            out += word(random, 8);
+            break;
+        case 1:
+            out += keywords[random() % 8];
+            break;
+        case 2:
+            out += std::to_string(random() % 100000);
+            if (random() % 4 == 0) {
+                out += "." + std::to_string(random() % 100);
+            }
+            break;
+        case 3:
+            out += '"' + word(random, 12) + '"';
+            break;
+        default:
+            out += operators[random() % 18];
+        }
+        out += random() % 16 == 0 ? '\n' : ' ';
+    }
+    return out;
+}
+
+// One flat chain of binary operators, divisors are never zero
+static std::string binary_chain(size_t size, std::mt19937 &random) {
+    std::string out = std::to_string(random() % 1000);
+    while (out.size() < size) {
+        const char *op = binary[random() % 8];
+        out += op;
+        out += std::to_string(op[1] == '/' ? random() % 999 + 1
+                                           : random() % 1000);
+    }
+    return out;
+}
+
+// Grouping and unary chains hundreds of levels deep, added together
+static std::string nested(size_t size, std::mt19937 &random) {
+    std::string out;
+    while (out.size() < size) {
+        if (!out.empty()) {
+            out += " + ";
+        }
+        int depth = 64 + random() % 448;
+        int groups = 0;
+        for (int i = 0; i < depth; i++) {
+            switch (random() % 3) {
+            case 0:
+                out += '(';
+                groups++;
+                break;
+            case 1:
+                out += '-';
+                break;
+            default:
+                out += '!';
+            }
+        }
+        out += std::to_string(random() % 1000);
+        out.append(groups, ')');
+    }
+    return out;
+}
+
+// Long string literals compared with each other, one per line
+static std::string strings(size_t size, std::mt19937 &random) {
+    std::string out;
+    while (out.size() < size) {
+        if (!out.empty()) {
+            out += " ==\n";
+        }
+        out += '"';
+        int words = 4 + random() % 12;
+        for (int i = 0; i < words; i++) {
+            out += word(random, 9) + ' ';
+        }
+        out += '"';
+    }
+    return out;
+}
+
+// A comment line after every term of a chain
+static std::string comments(size_t size, std::mt19937 &random) {
+    std::string out = "0";
+    while (out.size() < size) {
+        out += " // ";
+        int words = 4 + random() % 12;
+        for (int i = 0; i < words; i++) {
+            out += word(random, 9) + ' ';
+        }
+        out += '\n';
+        out += binary[random() % 3];
+        out += std::to_string(random() % 1000);
+    }
+    return out;
+}
+
+struct Corpus {
+    const char *name;
+    std::string (*generate)(size_t size, std::mt19937 &random);
+};
+
+static const Corpus corpora[] = {
+    {"token_soup", token_soup}, {"binary_chain", binary_chain},
+    {"nested", nested},         {"strings", strings},
+    {"comments", comments},
+};
+
+/*
+ * Measurement
+ */
+
+struct Timing {
+    double seconds; // median of the rounds
+    double noise;   // median distance of the rounds from it, relative
+};
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle]
+                             : (values[middle - 1] + values[middle]) / 2;
+}
+
+// Median time of the rounds, which neither an unwarmed first run nor one
+// lucky round moves
+static Timing median_time(int rounds, const std::function<void()> &run) {
+    std::vector<double> times;
+    for (int round = 0; round < std::max(rounds, 1); round++) {
+        auto start = Clock::now();
+        run();
+        times.push_back(
+            std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    double seconds = median(times);
+    for (double &time : times) {
+        time = std::abs(time - seconds);
+    }
+    return {seconds, median(times) / seconds};
+}
+
+static void record(std::map<std::string, double> &result, const char *phase,
+                   Timing timing, size_t bytes, size_t tokens) {
+    result[std::string(phase) + "_mb_s"] = bytes / timing.seconds / 1e6;
+    result[std::string(phase) + "_mtokens_s"] = tokens / timing.seconds / 1e6;
+    result[std::string(phase) + "_noise"] = timing.noise;
+}
+
+static std::map<std::string, double> measure(const std::string &source,
+                                             int rounds) {
+    std::map<std::string, double> result;
+    result["bytes"] = source.size();
+
+    Interner interner;
+    std::ostringstream errors;
+    TokenStream tokens;
+    Timing timing = median_time(rounds, [&] {
+        tokens = lex(source, interner, errors);
+    });
+    result["tokens"] = tokens.size();
+    record(result, "lex", timing, source.size(), tokens.size());
+
+    Ast ast;
+    try {
+        timing = median_time(rounds, [&] {
+            ast = Ast();
+            ast.interner = &interner;
+            StreamSource stream(tokens);
+            Parser parser;
+            parser.parse(stream, ast);
+        });
+    } catch (std::exception &) {
+        return result;
+    }
+    record(result, "parse", timing, source.size(), tokens.size());
+
+    // IR, passes and assembly, as run.out --no-fold does
+    try {
+        timing = median_time(rounds, [&] {
+            IrBuilder builder;
+            IrFunction ir = builder.build(ast);
+            PassManager::standard().run(ir);
+            std::string assembly;
+            AsmWriter writer(&assembly);
+            make_backend("arm64")->generate(ir, writer);
+            writer.flush();
+        });
+    } catch (std::exception &) {
+        return result;
+    }
+    record(result, "codegen", timing, source.size(), tokens.size());
+    return result;
+}
+
+/*
+ * Results as JSON: one object per corpus, holding numbers only
+ */
+
+static void write_results(const Results &results, std::ostream &out) {
+    out << std::fixed << std::setprecision(3) << "{\n";
+    size_t corpus = 0;
+    for (const auto &[name, values] : results) {
+        out << "  \"" << name << "\": {";
+        size_t i = 0;
+        for (const auto &[key, value] : values) {
+            out << (i++ ? ", " : "") << '"' << key << "\": " << value;
+        }
+        out << (++corpus < results.size() ? "},\n" : "}\n");
+    }
+    out << "}\n";
+}
+
+// Reads what write_results writes, throws on anything else
+static Results read_results(std::istream &in) {
+    std::string text((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    size_t at = 0;
+    auto skip = [&] {
+        while (at < text.size() && isspace(text[at])) {
+            at++;
+        }
+    };
+    auto expect = [&](char c) {
+        skip();
+        if (at >= text.size() || text[at] != c) {
+            throw std::runtime_error("malformed baseline at byte " +
+                                     std::to_string(at));
+        }
+        at++;
+    };
+    auto string = [&] {
+        expect('"');
+        size_t end = text.find('"', at);
+        if (end == std::string::npos) {
+            throw std::runtime_error("unterminated string in baseline");
+        }
+        std::string out = text.substr(at, end - at);
+        at = end + 1;
+        return out;
+    };
+    auto peek = [&] {
+        skip();
+        return at < text.size() ? text[at] : '\0';
+    };
+
+    Results results;
+    expect('{');
+    while (peek() == '"') {
+        std::string corpus = string();
+        expect(':');
+        expect('{');
+        while (peek() == '"') {
+            std::string key = string();
+            expect(':');
+            skip();
+            char *end;
+            results[corpus][key] = strtod(text.c_str() + at, &end);
+            at = end - text.c_str();
+            if (peek() == ',') {
+                at++;
+            }
+        }
+        expect('}');
+        if (peek() == ',') {
+            at++;
+        }
+    }
+    expect('}');
+    return results;
+}
+
+static const char *const phases[] = {"lex", "parse", "codegen"};
+
+// How far below its baseline a phase's rate may drop, or a negative
+// number when there is no baseline for it
+static double allowed_drop(const std::map<std::string, double> &values,
+                           const Results &baseline, const std::string &name,
+                           const std::string &phase, double tolerance) {
+    auto corpus = baseline.find(name);
+    if (corpus == baseline.end() || !corpus->second.count(phase + "_mb_s")) {
+        return -1;
+    }
+    // Baselines stored before the noise was recorded have none
+    auto noise = [&](const std::map<std::string, double> &of) {
+        auto found = of.find(phase + "_noise");
+        return found == of.end() ? 0 : found->second;
+    };
+    return std::max(tolerance,
+                    3 * std::hypot(noise(values), noise(corpus->second)));
+}
+
+static bool regressed(const std::map<std::string, double> &values,
+                      const Results &baseline, const std::string &name,
+                      const std::string &phase, double tolerance) {
+    auto rate = values.find(phase + "_mb_s");
+    double drop = allowed_drop(values, baseline, name, phase, tolerance);
+    return rate != values.end() && drop >= 0 &&
+           rate->second / baseline.at(name).at(rate->first) - 1 < -drop;
+}
+
+// Keeps the faster of two measurements of each phase
+static void keep_faster(std::map<std::string, double> &values,
+                        const std::map<std::string, double> &again) {
+    for (std::string phase : phases) {
+        auto rate = again.find(phase + "_mb_s");
+        if (rate != again.end() && rate->second > values[rate->first]) {
+            for (const char *key : {"_mb_s", "_mtokens_s", "_noise"}) {
+                values[phase + key] = again.at(phase + key);
+            }
+        }
+    }
+}
+
+// Prints every rate next to its baseline, returns the number of rates that
+// dropped by more than they are allowed to
+static int compare(const Results &results, const Results &baseline,
+                   double tolerance) {
+    int regressions = 0;
+    std::cout << std::left << std::setw(14) << "corpus" << std::setw(10)
+              << "phase" << std::right << std::setw(10) << "MB/s"
+              << std::setw(12) << "Mtokens/s" << std::setw(8) << "noise"
+              << std::setw(12) << "base MB/s" << std::setw(9) << "change"
+              << std::setw(8) << "limit" << std::endl;
+    for (const auto &[name, values] : results) {
+        for (std::string phase : phases) {
+            auto rate = values.find(phase + "_mb_s");
+            if (rate == values.end()) {
+                continue;
+            }
+            std::cout << std::left << std::setw(14) << name << std::setw(10)
+                      << phase << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(10)
+                      << rate->second << std::setw(12)
+                      << values.at(phase + "_mtokens_s") << std::setw(7)
+                      << values.at(phase + "_noise") * 100 << '%';
+
+            double drop = allowed_drop(values, baseline, name, phase,
+                                       tolerance);
+            if (drop < 0) {
+                std::cout << std::setw(12) << "-" << std::endl;
+                continue;
+            }
+            double base = baseline.at(name).at(rate->first);
+            double change = rate->second / base - 1;
+            std::cout << std::setw(12) << base << std::setw(8)
+                      << std::showpos << change * 100 << '%' << std::setw(7)
+                      << -drop * 100 << std::noshowpos << '%';
+            if (regressed(values, baseline, name, phase, tolerance)) {
+                std::cout << "  REGRESSION";
+                regressions++;
+            }
+            std::cout << std::endl;
+        }
+    }
+    return regressions;
+}
+
+static int run(const Settings &settings) {
+    Results baseline;
+    if (!settings.baseline.empty()) {
+        std::ifstream in(settings.baseline);
+        if (!in) {
+            std::cerr << "Cannot read baseline " << settings.baseline
+                      << std::endl;
+            return 1;
+        }
+        baseline = read_results(in);
+    }
+
+    Results results;
+    for (const Corpus &corpus : corpora) {
+        std::mt19937 random(42);
+        std::string source = corpus.generate(settings.size, random);
+        if (!settings.corpus_dir.empty()) {
+            std::ofstream(settings.corpus_dir + "/" + corpus.name + ".ko")
+                << source;
+        }
+        std::map<std::string, double> &values = results[corpus.name];
+        values = measure(source, settings.rounds);
+        // A drop that does not hold up on a second measurement is noise
+        // the rounds did not catch, like other load on the machine
+        for (std::string phase : phases) {
+            if (regressed(values, baseline, corpus.name, phase,
+                          settings.tolerance)) {
+                keep_faster(values, measure(source, settings.rounds));
+                break;
+            }
+        }
+    }
+    int regressions = compare(results, baseline, settings.tolerance);
+
+    if (!settings.save.empty()) {
+        std::ofstream out(settings.save);
+        write_results(results, out);
+        if (!out) {
+            std::cerr << "Cannot write " << settings.save << std::endl;
+            return 1;
+        }
+    }
+    if (regressions > 0) {
+        std::cout << regressions << " rates further below the baseline "
+                  << "than their limit" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// The tree passes recurse once per level, deeper than the default stack
+// allows on the long chains
+static void *run_thread(void *argument) {
+    const Settings *settings = static_cast<const Settings *>(argument);
+    try {
+        return reinterpret_cast<void *>(intptr_t(run(*settings)));
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return reinterpret_cast<void *>(intptr_t(1));
+    }
+}
+
+int main(int argc, char const *argv[]) {
+    Settings settings;
+    for (int i = 1; i < argc; i++) {
+        std::string flag = argv[i];
+        if (flag.rfind("--baseline=", 0) == 0) {
+            settings.baseline = flag.substr(11);
+        } else if (flag.rfind("--save=", 0) == 0) {
+            settings.save = flag.substr(7);
+        } else if (flag.rfind("--corpus-dir=", 0) == 0) {
+            settings.corpus_dir = flag.substr(13);
+        } else if (flag.rfind("--size=", 0) == 0) {
+            settings.size = size_t(std::stod(flag.substr(7)) * (1 << 20));
+        } else if (flag.rfind("--rounds=", 0) == 0) {
+            settings.rounds = std::stoi(flag.substr(9));
+        } else if (flag.rfind("--tolerance=", 0) == 0) {
+            settings.tolerance = std::stod(flag.substr(12)) / 100;
+        } else {
+            std::cerr << "Unknown flag: " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, size_t(1) << 30);
+    pthread_t thread;
+    if (pthread_create(&thread, &attributes, run_thread, &settings) != 0) {
+        std::cerr << "Cannot start the benchmark thread" << std::endl;
+        return 1;
+    }
+    void *status;
+    pthread_join(thread, &status);
+    return int(intptr_t(status));
+}
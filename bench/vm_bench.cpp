@@ -0,0 +1,151 @@
+// Evaluation time of the bytecode VM against a naive recursive walk over
+// the same AST, both on balanced expressions of random literals.
+//
+//   make bench/vm_bench.out && ./bench/vm_bench.out [leaves] [rounds]
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "vm/vm.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+typedef std::chrono::steady_clock Clock;
+
+// Evaluates by recursion with the same semantics as the VM
+class TreeWalker : public Visitor<TreeWalker, int64_t> {
+  public:
+    int64_t evaluate(const Ast &ast) {
+        this->ast = &ast;
+        return visit(ast.root);
+    }
+
+    int64_t visit_binary_expr(NodeIndex index) {
+        const Node &node = ast->at(index);
+        int64_t left = visit(node.lhs);
+        int64_t right = visit(node.rhs);
+        switch (node.oprt) {
+        case PLUS:
+            return int64_t(uint64_t(left) + uint64_t(right));
+        case MINUS:
+            return int64_t(uint64_t(left) - uint64_t(right));
+        case STAR:
+            return int64_t(uint64_t(left) * uint64_t(right));
+        case SLASH:
+            if (right == 0) {
+                throw std::runtime_error("Runtime error: division by zero");
+            }
+            return right == -1 ? int64_t(0 - uint64_t(left)) : left / right;
+        case EQUAL_EQUAL:
+            return left == right;
+        case BANG_EQUAL:
+            return left != right;
+        case LESS:
+            return left < right;
+        case LESS_EQUAL:
+            return left <= right;
+        case GREATER:
+            return left > right;
+        case GREATER_EQUAL:
+            return left >= right;
+        default:
+            throw std::runtime_error("unsupported operator");
+        }
+    }
+
+    int64_t visit_grouping_expr(NodeIndex index) {
+        return visit(ast->at(index).lhs);
+    }
+
+    int64_t visit_literal_expr(NodeIndex index) {
+        const Node &node = ast->at(index);
+        switch (node.tag) {
+        case NODE_NUMBER:
+            return ast->number(index);
+        case NODE_BOOLEAN:
+            return node.lhs;
+        default:
+            return 0;
+        }
+    }
+
+    int64_t visit_unary_expr(NodeIndex index) {
+        const Node &node = ast->at(index);
+        int64_t operand = visit(node.lhs);
+        return node.oprt == BANG ? operand == 0 : int64_t(0 - uint64_t(operand));
+    }
+};
+
+// Divisors are literals from 1 to 9, so nothing divides by zero
+static void balanced(std::string &out, long leaves, std::mt19937 &random) {
+    if (leaves == 1) {
+        out += std::to_string(random() % 1000);
+        return;
+    }
+    static const char *const ops[] = {" + ", " - ", " * ", " < ", " == "};
+    out += '(';
+    balanced(out, leaves / 2, random);
+    if (random() % 8 == 0) {
+        out += " / " + std::to_string(random() % 9 + 1) + ')';
+        return;
+    }
+    out += ops[random() % 5];
+    balanced(out, leaves - leaves / 2, random);
+    out += ')';
+}
+
+template <typename F> static double time_rounds(int rounds, F run) {
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; round++) {
+        run();
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count() /
+           rounds;
+}
+
+int main(int argc, char const *argv[]) {
+    long leaves = argc > 1 ? std::stol(argv[1]) : 1000000;
+    int rounds = argc > 2 ? std::stoi(argv[2]) : 10;
+
+    std::mt19937 random(42);
+    std::string source;
+    balanced(source, leaves, random);
+
+    Interner interner;
+    TokenStream tokens = lex(source, interner);
+    StreamSource stream(tokens);
+    Ast ast;
+    Parser parser;
+    parser.parse(stream, ast);
+
+    Bytecode program;
+    double compile = time_rounds(1, [&] {
+        BytecodeCompiler compiler;
+        program = compiler.compile(ast);
+    });
+
+    // Results go through a volatile so neither loop is optimized away
+    volatile int64_t sink = 0;
+    TreeWalker walker;
+    double walk = time_rounds(rounds, [&] { sink = walker.evaluate(ast); });
+    int64_t walked = sink;
+    double vm = time_rounds(rounds, [&] { sink = run_bytecode(program); });
+    if (sink != walked) {
+        std::cerr << "VM result " << sink << " != tree walk " << walked
+                  << std::endl;
+        return 1;
+    }
+
+    size_t nodes = ast.nodes.size();
+    std::cout << nodes << " nodes, " << program.code.size()
+              << " instructions, " << program.registers << " registers"
+              << std::endl;
+    std::cout << "compile:   " << compile * 1000 << " ms" << std::endl;
+    std::cout << "tree walk: " << walk * 1000 << " ms, "
+              << walk / nodes * 1e9 << " ns/node" << std::endl;
+    std::cout << "vm:        " << vm * 1000 << " ms, " << vm / nodes * 1e9
+              << " ns/node, " << walk / vm << "x faster" << std::endl;
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include "arena.hpp"
+#include <cstdint>
+
+Arena::~Arena() {
+    for (char *block : blocks) {
+        delete[] block;
+    }
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + align - 1) &
+                        ~static_cast<uintptr_t>(align - 1);
+    if (!cursor || aligned + size > reinterpret_cast<uintptr_t>(limit)) {
+        grow(size + align);
+        aligned = (reinterpret_cast<uintptr_t>(cursor) + align - 1) &
+                  ~static_cast<uintptr_t>(align - 1);
+    }
+
+    cursor = reinterpret_cast<char *>(aligned + size);
+    used += size;
+    return reinterpret_cast<void *>(aligned);
+}
+
+void Arena::grow(size_t min_size) {
+    // Oversized requests get a block of their own
+    size_t size = min_size > block_size ? min_size : block_size;
+    char *block = new char[size];
+    blocks.push_back(block);
+    cursor = block;
+    limit = block + size;
+}
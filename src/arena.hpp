@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump pointer allocator. Objects are carved out of large blocks in the
+// order they are created and released all at once when the arena goes
+// away, so destructors are never run.
+class Arena {
+  public:
+    explicit Arena(size_t block_size = 64 * 1024) : block_size(block_size) {}
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t size, size_t align);
+
+    template <typename T, typename... Args> T *make(Args &&...args) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "Arena never runs destructors");
+        return new (allocate(sizeof(T), alignof(T)))
+            T(std::forward<Args>(args)...);
+    }
+
+    size_t bytes_used() const { return used; }
+
+  private:
+    size_t block_size;
+    std::vector<char *> blocks;
+    char *cursor = nullptr;
+    char *limit = nullptr;
+    size_t used = 0;
+
+    void grow(size_t min_size);
+};
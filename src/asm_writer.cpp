@@ -0,0 +1,132 @@
+#include "asm_writer.hpp"
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+AsmWriter::AsmWriter(int fd, size_t capacity) : fd(fd) {
+    for (Buffer &buffer : buffers) {
+        buffer.bytes.resize(capacity);
+    }
+    current = &buffers[TEXT];
+}
+
+AsmWriter::AsmWriter(std::string *into, size_t capacity) : into(into) {
+    for (Buffer &buffer : buffers) {
+        buffer.bytes.resize(capacity);
+    }
+    current = &buffers[TEXT];
+}
+
+void AsmWriter::set_directive(Section section, std::string_view directive) {
+    buffers[section].directive = directive;
+}
+
+void AsmWriter::Buffer::append(const char *data, size_t size) {
+    memcpy(bytes.data() + used, data, size);
+    used += size;
+}
+
+// Two digits per division, from a table of "00" to "99"
+AsmWriter &AsmWriter::integer(uint64_t magnitude, bool negative) {
+    static const char pairs[] = "00010203040506070809"
+                                "10111213141516171819"
+                                "20212223242526272829"
+                                "30313233343536373839"
+                                "40414243444546474849"
+                                "50515253545556575859"
+                                "60616263646566676869"
+                                "70717273747576777879"
+                                "80818283848586878889"
+                                "90919293949596979899";
+    char digits[20];
+    char *end = digits + sizeof(digits);
+    char *start = end;
+
+    while (magnitude >= 100) {
+        const char *pair = pairs + (magnitude % 100) * 2;
+        magnitude /= 100;
+        *--start = pair[1];
+        *--start = pair[0];
+    }
+    if (magnitude >= 10) {
+        const char *pair = pairs + magnitude * 2;
+        *--start = pair[1];
+        *--start = pair[0];
+    } else {
+        *--start = char('0' + magnitude);
+    }
+
+    if (negative) {
+        *this << '-';
+    }
+    return *this << std::string_view(start, end - start);
+}
+
+// Only called on a full buffer, which drain() makes room in
+AsmWriter &AsmWriter::append_slow(std::string_view text) {
+    while (!text.empty()) {
+        if (current->free() == 0) {
+            drain(*current);
+        }
+        size_t chunk = std::min(text.size(), current->free());
+        current->append(text.data(), chunk);
+        text.remove_prefix(chunk);
+    }
+    return *this;
+}
+
+// Writes the buffer's complete lines, or all of it when whole is set, so
+// that the other section's directive never lands inside a line. The
+// unfinished line moves to the front. A line that fills the whole buffer
+// grows it instead.
+void AsmWriter::drain(Buffer &buffer, bool whole) {
+    size_t size = buffer.used;
+    if (!whole) {
+        size_t newline =
+            std::string_view(buffer.bytes.data(), buffer.used).rfind('\n');
+        if (newline == std::string_view::npos) {
+            buffer.bytes.resize(buffer.bytes.size() * 2);
+            return;
+        }
+        size = newline + 1;
+    }
+    if (size == 0) {
+        return;
+    }
+    if (last_written != &buffer) {
+        write(buffer.directive.data(), buffer.directive.size());
+        last_written = &buffer;
+    }
+    write(buffer.bytes.data(), size);
+    memmove(buffer.bytes.data(), buffer.bytes.data() + size,
+            buffer.used - size);
+    buffer.used -= size;
+}
+
+void AsmWriter::flush() {
+    drain(buffers[DATA], true);
+    drain(buffers[TEXT], true);
+}
+
+void AsmWriter::write(const char *data, size_t size) {
+    written += size;
+    if (into) {
+        into->append(data, size);
+        return;
+    }
+
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw std::runtime_error(std::string("Cannot write output: ") +
+                                     strerror(errno));
+        }
+        data += n;
+        size -= n;
+    }
+}
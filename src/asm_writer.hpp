@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Assembly output with one fixed-size buffer per section. The complete
+// lines of a buffer that fills up are written out at once, preceded by its
+// section directive when the output switches sections, so memory use does
+// not grow with the program. Output goes to a file descriptor or is
+// appended to a string.
+class AsmWriter {
+  public:
+    enum Section { TEXT, DATA };
+
+    explicit AsmWriter(int fd, size_t capacity = 64 * 1024);
+    explicit AsmWriter(std::string *into, size_t capacity = 64 * 1024);
+
+    // Directive written before the contents of a section, e.g. ".text"
+    void set_directive(Section section, std::string_view directive);
+
+    // Section the following writes go to, TEXT at first
+    void section(Section section) { current = &buffers[section]; }
+
+    AsmWriter &operator<<(std::string_view text) {
+        if (text.size() > current->free()) {
+            return append_slow(text);
+        }
+        current->append(text.data(), text.size());
+        return *this;
+    }
+
+    AsmWriter &operator<<(char c) {
+        if (current->free() == 0) {
+            drain(*current);
+        }
+        current->bytes[current->used++] = c;
+        return *this;
+    }
+
+    AsmWriter &operator<<(const char *text) {
+        return *this << std::string_view(text);
+    }
+
+    AsmWriter &operator<<(int64_t value) {
+        return integer(value < 0 ? 0 - uint64_t(value) : value, value < 0);
+    }
+    AsmWriter &operator<<(uint64_t value) { return integer(value, false); }
+    AsmWriter &operator<<(int value) { return *this << int64_t(value); }
+    AsmWriter &operator<<(unsigned value) { return *this << uint64_t(value); }
+
+    // Writes what is still buffered, data before text. Throws
+    // std::runtime_error when the file descriptor cannot be written.
+    void flush();
+
+    uint64_t bytes_written() const { return written; }
+
+  private:
+    struct Buffer {
+        std::vector<char> bytes;
+        size_t used = 0;
+        std::string directive;
+
+        size_t free() const { return bytes.size() - used; }
+        void append(const char *data, size_t size);
+    };
+
+    Buffer buffers[2];
+    Buffer *current;
+    const Buffer *last_written = nullptr;
+    int fd = -1;
+    std::string *into = nullptr;
+    uint64_t written = 0;
+
+    AsmWriter &integer(uint64_t magnitude, bool negative);
+    AsmWriter &append_slow(std::string_view text);
+    void drain(Buffer &buffer, bool whole = false);
+    void write(const char *data, size_t size);
+};
@@ -0,0 +1,140 @@
+#include "arm64_encoder.hpp"
+#include <stdexcept>
+
+// Register 31 is xzr in data processing instructions and sp as the base of
+// loads and stores and in add/sub with an immediate
+static const uint32_t XZR = 31;
+
+// A64 condition codes in the order of Condition
+static const uint32_t condition_codes[] = {0x0, 0x1, 0xb, 0xd, 0xc, 0xa};
+
+static void put(std::vector<uint8_t> &code, uint32_t word) {
+    code.push_back(word);
+    code.push_back(word >> 8);
+    code.push_back(word >> 16);
+    code.push_back(word >> 24);
+}
+
+static uint32_t reg(Reg number) {
+    if (number > 31) {
+        throw std::runtime_error("Encoder: register was not allocated");
+    }
+    return number;
+}
+
+// rd = rn op imm, imm is 12 bits optionally shifted left by 12
+static uint32_t add_sub_immediate(uint32_t base, uint32_t rd, uint32_t rn,
+                                  int64_t imm) {
+    if (imm >> 12) {
+        if (imm & 0xfff || imm >> 24) {
+            throw std::runtime_error("Encoder: immediate out of range");
+        }
+        return base | 1u << 22 | uint32_t(imm >> 12) << 10 | rn << 5 | rd;
+    }
+    return base | uint32_t(imm) << 10 | rn << 5 | rd;
+}
+
+static uint32_t three_registers(uint32_t base, uint32_t rd, uint32_t rn,
+                                uint32_t rm) {
+    return base | rm << 16 | rn << 5 | rd;
+}
+
+// ldr/str with an unsigned offset scaled by 8
+static uint32_t load_store(uint32_t base, uint32_t rt, int64_t offset) {
+    if (offset < 0 || offset % 8 || offset / 8 >= 4096) {
+        throw std::runtime_error("Encoder: stack offset out of range");
+    }
+    return base | uint32_t(offset / 8) << 10 | reg(SP) << 5 | rt;
+}
+
+static void encode(std::vector<uint8_t> &code, const MachineInstr &instr,
+                   bool returns) {
+    switch (instr.op) {
+    case MI_MOV_IMM:
+        if (instr.imm >= 0) {
+            put(code, 0xd2800000 | uint32_t(instr.imm) << 5 | reg(instr.dst));
+        } else {
+            put(code, 0x92800000 | uint32_t(~instr.imm) << 5 | reg(instr.dst));
+        }
+        break;
+    case MI_MOVK: {
+        uint64_t bits = instr.imm;
+        uint32_t hw = 1;
+        while (!(bits >> (hw * 16) & 0xffff)) {
+            hw++;
+        }
+        uint32_t chunk = bits >> (hw * 16) & 0xffff;
+        put(code, 0xf2800000 | hw << 21 | chunk << 5 | reg(instr.dst));
+        break;
+    }
+    case MI_MOV: // orr rd, xzr, rm
+        put(code, three_registers(0xaa000000, reg(instr.dst), XZR,
+                                  reg(instr.lhs)));
+        break;
+    case MI_ADD:
+    case MI_SUB: {
+        bool add = instr.op == MI_ADD;
+        if (instr.rhs == NO_REG) {
+            put(code, add_sub_immediate(add ? 0x91000000 : 0xd1000000,
+                                        reg(instr.dst), reg(instr.lhs),
+                                        instr.imm));
+        } else {
+            put(code, three_registers(add ? 0x8b000000 : 0xcb000000,
+                                      reg(instr.dst), reg(instr.lhs),
+                                      reg(instr.rhs)));
+        }
+        break;
+    }
+    case MI_MUL: // madd rd, rn, rm, xzr
+        put(code, three_registers(0x9b007c00, reg(instr.dst), reg(instr.lhs),
+                                  reg(instr.rhs)));
+        break;
+    case MI_SDIV:
+        put(code, three_registers(0x9ac00c00, reg(instr.dst), reg(instr.lhs),
+                                  reg(instr.rhs)));
+        break;
+    case MI_NEG: // sub rd, xzr, rm
+        put(code, three_registers(0xcb000000, reg(instr.dst), XZR,
+                                  reg(instr.lhs)));
+        break;
+    case MI_CMP_SET: {
+        // subs xzr, rn, op2 then csinc rd, xzr, xzr, !cond
+        if (instr.rhs == NO_REG) {
+            put(code,
+                add_sub_immediate(0xf1000000, XZR, reg(instr.lhs), instr.imm));
+        } else {
+            put(code, three_registers(0xeb000000, XZR, reg(instr.lhs),
+                                      reg(instr.rhs)));
+        }
+        uint32_t inverted = condition_codes[instr.cond] ^ 1;
+        put(code, three_registers(0x9a800400 | inverted << 12, reg(instr.dst),
+                                  XZR, XZR));
+        break;
+    }
+    case MI_LOAD:
+        put(code, load_store(0xf9400000, reg(instr.dst), instr.imm));
+        break;
+    case MI_STORE:
+        put(code, load_store(0xf9000000, reg(instr.lhs), instr.imm));
+        break;
+    case MI_LEA:
+        throw std::runtime_error("Encoder: lea is not an ARM64 instruction");
+    case MI_RETURN:
+        if (returns) {
+            put(code, 0xd65f03c0); // ret (x30)
+            break;
+        }
+        put(code, 0xd2800000 | 93 << 5 | 8); // mov x8, #93 (exit)
+        put(code, 0xd4000001);               // svc #0
+        break;
+    }
+}
+
+std::vector<uint8_t> encode_arm64(const MachineFunction &function) {
+    std::vector<uint8_t> code;
+    code.reserve(function.code.size() * 8);
+    for (const MachineInstr &instr : function.code) {
+        encode(code, instr, function.returns);
+    }
+    return code;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "../machine.hpp"
+#include <cstdint>
+#include <vector>
+
+// Encodes a function that went through CodeGenerator::compile() into A64
+// machine code. The program exits through the Linux exit syscall, a
+// function that returns ends in ret.
+std::vector<uint8_t> encode_arm64(const MachineFunction &function);
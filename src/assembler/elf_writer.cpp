@@ -0,0 +1,168 @@
+#include "elf_writer.hpp"
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+static const uint64_t TEXT_BASE = 0x400000;
+static const uint64_t DATA_BASE = 0x600000;
+static const uint64_t PAGE = 0x1000;
+
+namespace {
+// Appends headers and section contents to one growing file image
+struct Layout {
+    std::vector<uint8_t> bytes;
+
+    template <typename T> size_t put(const T &value) {
+        return put(&value, sizeof(value));
+    }
+
+    size_t put(const void *data, size_t size) {
+        size_t offset = bytes.size();
+        bytes.insert(bytes.end(), static_cast<const uint8_t *>(data),
+                     static_cast<const uint8_t *>(data) + size);
+        return offset;
+    }
+
+    void align(size_t alignment) {
+        bytes.resize((bytes.size() + alignment - 1) & ~(alignment - 1));
+    }
+
+    template <typename T> T *at(size_t offset) {
+        return reinterpret_cast<T *>(bytes.data() + offset);
+    }
+};
+} // namespace
+
+std::vector<uint8_t> build_elf(const ElfImage &image, ElfKind kind) {
+    bool executable = kind == ELF_EXECUTABLE;
+    bool has_data = !image.data.empty();
+    uint16_t segments = executable ? (has_data ? 2 : 1) : 0;
+
+    Layout file;
+    Elf64_Ehdr header = {};
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = executable ? ET_EXEC : ET_REL;
+    header.e_machine = image.machine;
+    header.e_version = EV_CURRENT;
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_phentsize = segments ? sizeof(Elf64_Phdr) : 0;
+    header.e_phnum = segments;
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    file.put(header);
+
+    size_t phdrs = file.bytes.size();
+    for (uint16_t i = 0; i < segments; i++) {
+        file.put(Elf64_Phdr{});
+    }
+
+    // The text segment maps the headers as well, so .text needs no padding
+    // to a page boundary. Data addresses keep the file offset modulo the
+    // page size, as the loader requires.
+    file.align(16);
+    size_t text_offset = file.put(image.text.data(), image.text.size());
+    uint64_t text_address = executable ? TEXT_BASE + text_offset : 0;
+
+    file.align(16);
+    size_t data_offset = file.put(image.data.data(), image.data.size());
+    uint64_t data_address = executable ? DATA_BASE + data_offset % PAGE : 0;
+
+    if (executable) {
+        header.e_entry = text_address;
+        header.e_phoff = phdrs;
+
+        Elf64_Phdr *text = file.at<Elf64_Phdr>(phdrs);
+        text->p_type = PT_LOAD;
+        text->p_flags = PF_R | PF_X;
+        text->p_offset = 0;
+        text->p_vaddr = text->p_paddr = TEXT_BASE;
+        text->p_filesz = text->p_memsz = text_offset + image.text.size();
+        text->p_align = PAGE;
+
+        if (has_data) {
+            Elf64_Phdr *data = text + 1;
+            data->p_type = PT_LOAD;
+            data->p_flags = PF_R | PF_W;
+            data->p_offset = data_offset;
+            data->p_vaddr = data->p_paddr = data_address;
+            data->p_filesz = data->p_memsz = image.data.size();
+            data->p_align = PAGE;
+        }
+    }
+
+    // Symbol table: the null symbol and _start
+    const char strtab[] = "\0_start";
+    file.align(8);
+    size_t symtab_offset = file.put(Elf64_Sym{});
+    Elf64_Sym start = {};
+    start.st_name = 1;
+    start.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+    start.st_shndx = 1; // .text
+    start.st_value = text_address;
+    start.st_size = image.text.size();
+    file.put(start);
+    size_t strtab_offset = file.put(strtab, sizeof(strtab));
+
+    const char shstrtab[] = "\0.text\0.data\0.symtab\0.strtab\0.shstrtab";
+    size_t shstrtab_offset = file.put(shstrtab, sizeof(shstrtab));
+
+    // Sections: null, .text, .data, .symtab, .strtab, .shstrtab
+    Elf64_Shdr sections[6] = {};
+    sections[1] = {1,   SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR,
+                   text_address,  text_offset, image.text.size(),
+                   0,   0,            16,
+                   0};
+    sections[2] = {7,  SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,
+                   data_address, data_offset, image.data.size(),
+                   0,  0,            16,
+                   0};
+    sections[3] = {13, SHT_SYMTAB, 0, 0, symtab_offset, 2 * sizeof(Elf64_Sym),
+                   4,  1,          8, sizeof(Elf64_Sym)};
+    sections[4] = {21, SHT_STRTAB, 0, 0, strtab_offset, sizeof(strtab),
+                   0,  0,          1, 0};
+    sections[5] = {29, SHT_STRTAB, 0, 0, shstrtab_offset, sizeof(shstrtab),
+                   0,  0,          1, 0};
+
+    file.align(8);
+    header.e_shoff = file.bytes.size();
+    header.e_shnum = 6;
+    header.e_shstrndx = 5;
+    for (const Elf64_Shdr &section : sections) {
+        file.put(section);
+    }
+
+    memcpy(file.bytes.data(), &header, sizeof(header));
+    return std::move(file.bytes);
+}
+
+void write_elf(const std::string &path, const ElfImage &image, ElfKind kind) {
+    std::vector<uint8_t> bytes = build_elf(image, kind);
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                  kind == ELF_EXECUTABLE ? 0755 : 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path + ": " +
+                                 strerror(errno));
+    }
+
+    size_t written = 0;
+    while (written < bytes.size()) {
+        ssize_t n = write(fd, bytes.data() + written, bytes.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error("Cannot write " + path + ": " +
+                                     strerror(error));
+        }
+        written += n;
+    }
+    close(fd);
+}
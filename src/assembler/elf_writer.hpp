@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum ElfKind {
+    ELF_EXECUTABLE,  // static, entry point at the start of .text
+    ELF_RELOCATABLE, // object file defining _start at the start of .text
+};
+
+struct ElfImage {
+    uint16_t machine; // EM_AARCH64, EM_X86_64
+    std::vector<uint8_t> text;
+    std::vector<uint8_t> data;
+};
+
+// Lays out .text and .data and their headers in memory and writes the
+// file in one go. Throws std::runtime_error when the file cannot be
+// written.
+std::vector<uint8_t> build_elf(const ElfImage &image, ElfKind kind);
+void write_elf(const std::string &path, const ElfImage &image, ElfKind kind);
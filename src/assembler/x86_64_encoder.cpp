@@ -0,0 +1,248 @@
+#include "x86_64_encoder.hpp"
+#include <stdexcept>
+#include <utility>
+
+static const Reg RAX = 0;
+static const Reg RSP = 4;
+
+// setcc opcodes in the order of Condition
+static const uint8_t setcc_opcodes[] = {0x94, 0x95, 0x9c, 0x9e, 0x9f, 0x9d};
+
+static bool fits_imm8(int64_t value) { return value >= -128 && value < 128; }
+
+static bool fits_imm32(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+namespace {
+struct Code {
+    std::vector<uint8_t> bytes;
+
+    void byte(uint8_t value) { bytes.push_back(value); }
+
+    void imm32(int64_t value) {
+        for (int i = 0; i < 4; i++) {
+            bytes.push_back(uint8_t(value >> (8 * i)));
+        }
+    }
+
+    void imm64(int64_t value) {
+        for (int i = 0; i < 8; i++) {
+            bytes.push_back(uint8_t(value >> (8 * i)));
+        }
+    }
+
+    void rex(bool w, Reg reg, Reg index, Reg base, bool force = false) {
+        uint8_t rex = 0x40 | w << 3 | (reg != NO_REG && reg >= 8) << 2 |
+                      (index != NO_REG && index >= 8) << 1 |
+                      (base != NO_REG && base >= 8);
+        if (rex != 0x40 || force) {
+            byte(rex);
+        }
+    }
+
+    void modrm(uint8_t mod, Reg reg, Reg rm) {
+        byte(mod << 6 | (reg & 7) << 3 | (rm & 7));
+    }
+
+    // 64-bit opcode with a register operand in both fields
+    void registers(uint8_t opcode, Reg reg, Reg rm) {
+        rex(true, reg, NO_REG, rm);
+        byte(opcode);
+        modrm(3, reg, rm);
+    }
+
+    // 64-bit opcode with an opcode extension and a register operand
+    void extension(uint8_t opcode, uint8_t digit, Reg rm) {
+        rex(true, NO_REG, NO_REG, rm);
+        byte(opcode);
+        modrm(3, digit, rm);
+    }
+
+    // 64-bit opcode with a [base + index * scale + disp] operand, either of
+    // base and index may be missing
+    void memory(uint8_t opcode, Reg reg, Reg base, Reg index, uint8_t scale,
+                int64_t disp) {
+        if (base == NO_REG && scale == 1) {
+            std::swap(base, index); // [index*1] is shorter as [base]
+        }
+        rex(true, reg, index, base);
+        byte(opcode);
+
+        bool has_base = base != NO_REG;
+        bool sib = index != NO_REG || !has_base || (base & 7) == RSP;
+        uint8_t mod;
+        if (!has_base || (disp == 0 && (base & 7) != 5)) {
+            mod = 0; // rbp and r13 as base always carry a displacement
+        } else if (fits_imm8(disp)) {
+            mod = 1;
+        } else {
+            mod = 2;
+        }
+        modrm(mod, reg, sib ? RSP : base);
+
+        if (sib) {
+            uint8_t ss = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+            Reg index_field = index == NO_REG ? RSP : index;
+            Reg base_field = has_base ? base : 5;
+            byte(ss << 6 | (index_field & 7) << 3 | (base_field & 7));
+        }
+        if (mod == 1) {
+            byte(uint8_t(disp));
+        } else if (mod == 2 || !has_base) {
+            imm32(disp);
+        }
+    }
+
+    // add, sub or cmp of a register with a register or an immediate
+    void arithmetic(uint8_t opcode, uint8_t digit, Reg rm,
+                    const MachineInstr &instr) {
+        if (instr.rhs != NO_REG) {
+            registers(opcode, instr.rhs, rm);
+        } else if (fits_imm8(instr.imm)) {
+            extension(0x83, digit, rm);
+            byte(uint8_t(instr.imm));
+        } else {
+            extension(0x81, digit, rm);
+            imm32(instr.imm);
+        }
+    }
+
+    void imul(Reg dst, Reg src) {
+        rex(true, dst, NO_REG, src);
+        byte(0x0f);
+        byte(0xaf);
+        modrm(3, dst, src);
+    }
+};
+
+struct Arithmetic {
+    uint8_t opcode; // r/m64, r64 form
+    uint8_t digit;  // extension of the immediate forms
+};
+
+const Arithmetic ADD = {0x01, 0};
+const Arithmetic SUB = {0x29, 5};
+const Arithmetic CMP = {0x39, 7};
+} // namespace
+
+// dst = lhs op rhs, the same expansion as X86CodeGenerator::two_address
+static void two_address(Code &code, Arithmetic op, const MachineInstr &instr,
+                        bool commutative) {
+    if (instr.dst == instr.lhs) {
+        code.arithmetic(op.opcode, op.digit, instr.dst, instr);
+    } else if (instr.dst == instr.rhs && commutative) {
+        code.registers(op.opcode, instr.lhs, instr.dst);
+    } else if (instr.dst == instr.rhs) {
+        code.extension(0xf7, 3, instr.dst); // neg
+        code.registers(ADD.opcode, instr.lhs, instr.dst);
+    } else {
+        code.registers(0x89, instr.lhs, instr.dst);
+        code.arithmetic(op.opcode, op.digit, instr.dst, instr);
+    }
+}
+
+static void encode(Code &code, const MachineInstr &instr, bool returns) {
+    Reg dst = instr.dst;
+    switch (instr.op) {
+    case MI_MOV_IMM:
+        if (instr.imm >= 0 && instr.imm <= UINT32_MAX) {
+            code.rex(false, NO_REG, NO_REG, dst);
+            code.byte(0xb8 + (dst & 7));
+            code.imm32(instr.imm);
+        } else if (fits_imm32(instr.imm)) {
+            code.extension(0xc7, 0, dst);
+            code.imm32(instr.imm);
+        } else {
+            code.rex(true, NO_REG, NO_REG, dst);
+            code.byte(0xb8 + (dst & 7));
+            code.imm64(instr.imm);
+        }
+        break;
+    case MI_MOV:
+        code.registers(0x89, instr.lhs, dst);
+        break;
+    case MI_LEA:
+        code.memory(0x8d, dst, instr.lhs, instr.rhs, instr.scale, instr.imm);
+        break;
+    case MI_ADD:
+        two_address(code, ADD, instr, true);
+        break;
+    case MI_SUB:
+        two_address(code, SUB, instr, false);
+        break;
+    case MI_MUL:
+        if (instr.rhs == NO_REG) {
+            code.rex(true, dst, NO_REG, instr.lhs);
+            code.byte(fits_imm8(instr.imm) ? 0x6b : 0x69);
+            code.modrm(3, dst, instr.lhs);
+            if (fits_imm8(instr.imm)) {
+                code.byte(uint8_t(instr.imm));
+            } else {
+                code.imm32(instr.imm);
+            }
+        } else if (dst == instr.lhs) {
+            code.imul(dst, instr.rhs);
+        } else if (dst == instr.rhs) {
+            code.imul(dst, instr.lhs);
+        } else {
+            code.registers(0x89, instr.lhs, dst);
+            code.imul(dst, instr.rhs);
+        }
+        break;
+    case MI_SDIV:
+        code.registers(0x89, instr.lhs, RAX);
+        code.byte(0x48); // cqo
+        code.byte(0x99);
+        code.extension(0xf7, 7, instr.rhs); // idiv
+        code.registers(0x89, RAX, dst);
+        break;
+    case MI_NEG:
+        if (dst != instr.lhs) {
+            code.registers(0x89, instr.lhs, dst);
+        }
+        code.extension(0xf7, 3, dst);
+        break;
+    case MI_CMP_SET: {
+        code.arithmetic(CMP.opcode, CMP.digit, instr.lhs, instr);
+        // spl, bpl, sil and dil need a REX prefix, ah to bh are without
+        bool byte_rex = dst >= 4 && dst < 8;
+        code.rex(false, NO_REG, NO_REG, dst, byte_rex);
+        code.byte(0x0f);
+        code.byte(setcc_opcodes[instr.cond]);
+        code.modrm(3, 0, dst);
+        code.rex(false, dst, NO_REG, dst, byte_rex); // movzx r32, r8
+        code.byte(0x0f);
+        code.byte(0xb6);
+        code.modrm(3, dst, dst);
+        break;
+    }
+    case MI_LOAD:
+        code.memory(0x8b, dst, RSP, NO_REG, 1, instr.imm);
+        break;
+    case MI_STORE:
+        code.memory(0x89, instr.lhs, RSP, NO_REG, 1, instr.imm);
+        break;
+    case MI_RETURN:
+        if (returns) {
+            code.byte(0xc3);
+        } else {
+            code.byte(0xb8); // mov eax, 60 (exit)
+            code.imm32(60);
+            code.byte(0x0f); // syscall
+            code.byte(0x05);
+        }
+        break;
+    case MI_MOVK:
+        throw std::runtime_error("Encoder: movk is not an x86-64 instruction");
+    }
+}
+
+std::vector<uint8_t> encode_x86_64(const MachineFunction &function) {
+    Code code;
+    code.bytes.reserve(function.code.size() * 6);
+    for (const MachineInstr &instr : function.code) {
+        encode(code, instr, function.returns);
+    }
+    return std::move(code.bytes);
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "../machine.hpp"
+#include <cstdint>
+#include <vector>
+
+// Encodes a function that went through X86CodeGenerator::compile() into
+// x86-64 machine code, choosing the same instruction forms as the
+// assembly printer and the shortest immediates and displacements.
+std::vector<uint8_t> encode_x86_64(const MachineFunction &function);
@@ -0,0 +1,31 @@
+#include "ast.hpp"
+
+NodeIndex Ast::add(NodeTag tag, TokenType oprt, uint32_t main_token,
+                   uint32_t lhs, uint32_t rhs) {
+    Node node;
+    node.tag = tag;
+    node.oprt = oprt;
+    node.main_token = main_token;
+    node.lhs = lhs;
+    node.rhs = rhs;
+    nodes.push_back(node);
+    return nodes.size() - 1;
+}
+
+NodeIndex Ast::add_number(uint32_t main_token, int64_t value) {
+    uint32_t slot = extra.size();
+    uint64_t bits = static_cast<uint64_t>(value);
+    extra.push_back(static_cast<uint32_t>(bits));
+    extra.push_back(static_cast<uint32_t>(bits >> 32));
+    return add(NODE_NUMBER, NUMBER, main_token, slot, 0);
+}
+
+int64_t Ast::number(NodeIndex index) const {
+    uint32_t slot = nodes[index].lhs;
+    uint64_t bits = extra[slot] | static_cast<uint64_t>(extra[slot + 1]) << 32;
+    return static_cast<int64_t>(bits);
+}
+
+std::string_view Ast::string(NodeIndex index) const {
+    return interner->text(nodes[index].lhs);
+}
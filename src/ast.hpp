@@ -0,0 +1,45 @@
+#pragma once
+#include "token_stream.hpp"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+typedef uint32_t NodeIndex;
+
+enum NodeTag : uint8_t {
+    NODE_BINARY,   // lhs, rhs: operands
+    NODE_GROUPING, // lhs: inner expression
+    NODE_UNARY,    // lhs: operand
+    NODE_NUMBER,   // lhs: index of the 64-bit value in extra (two words)
+    NODE_STRING,   // lhs: intern id
+    NODE_BOOLEAN,  // lhs: 0 or 1
+    NODE_NIL,
+};
+
+// One entry of the node table. Operands refer to other nodes by index, so
+// the whole tree is a flat array that later passes can walk linearly.
+struct Node {
+    NodeTag tag;
+    TokenType oprt;      // operator of BINARY and UNARY nodes
+    uint32_t main_token; // index of the token the node was built from
+    uint32_t lhs;
+    uint32_t rhs;
+};
+
+static_assert(sizeof(Node) == 16, "Node should stay 16 bytes");
+
+class Ast {
+  public:
+    std::vector<Node> nodes;
+    std::vector<uint32_t> extra; // payloads that do not fit in a node
+    NodeIndex root = 0;
+    const Interner *interner = nullptr;
+
+    const Node &at(NodeIndex index) const { return nodes[index]; }
+    NodeIndex add(NodeTag tag, TokenType oprt, uint32_t main_token,
+                  uint32_t lhs, uint32_t rhs);
+    NodeIndex add_number(uint32_t main_token, int64_t value);
+
+    int64_t number(NodeIndex index) const;
+    std::string_view string(NodeIndex index) const;
+};
@@ -0,0 +1,23 @@
+#include "backend.hpp"
+#include "codegen.hpp"
+#include "codegen_x86_64.hpp"
+
+std::unique_ptr<Backend> make_backend(std::string_view target) {
+    if (target == "arm64") {
+        return std::make_unique<CodeGenerator>();
+    }
+    if (target == "x86_64-linux") {
+        return std::make_unique<X86CodeGenerator>();
+    }
+    return nullptr;
+}
+
+const char *native_target() {
+#if defined(__aarch64__)
+    return "arm64";
+#elif defined(__x86_64__) && defined(__linux__)
+    return "x86_64-linux";
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "asm_writer.hpp"
+#include "assembler/elf_writer.hpp"
+#include "ir/ir.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Where the value of a lowered IR instruction lives
+struct Operand {
+    enum Kind { NONE, IMMEDIATE, REGISTER };
+    Kind kind;
+    int64_t value; // immediate value or virtual register
+
+    static Operand none() { return {NONE, 0}; }
+    static Operand immediate(int64_t value) { return {IMMEDIATE, value}; }
+    static Operand reg(int64_t number) { return {REGISTER, number}; }
+};
+
+// Code generator for one target, selected with --target
+class Backend {
+  public:
+    virtual ~Backend() {}
+
+    // Assembly text for the target's assembler, streamed into out
+    virtual void generate(const IrFunction &ir, AsmWriter &out) = 0;
+
+    // Machine code laid out for an ELF file
+    virtual ElfImage encode(const IrFunction &ir) = 0;
+
+    // Machine code of a function that returns the result to its caller
+    // under the platform's calling convention, for running in-process
+    virtual std::vector<uint8_t> encode_function(const IrFunction &ir) = 0;
+
+    // Machine instructions of the last function generated or encoded
+    size_t emitted = 0;
+};
+
+// Targets: arm64 (the default) and x86_64-linux. Returns nullptr for
+// anything else.
+std::unique_ptr<Backend> make_backend(std::string_view target);
+
+// Target of the machine the compiler runs on, nullptr when no backend
+// generates code for it
+const char *native_target();
@@ -0,0 +1,252 @@
+#include "cache.hpp"
+#include "sha256.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// Bumped when the layout of keys or entries changes
+static const char *const CACHE_FORMAT = "ko-cache-1";
+
+static void make_directory(const std::string &path) {
+    if (mkdir(path.c_str(), 0755) < 0 && errno != EEXIST) {
+        throw std::runtime_error("Cannot create cache directory " + path +
+                                 ": " + strerror(errno));
+    }
+}
+
+// Size and mtime of the running compiler: any rebuild changes the keys
+// without hashing the binary on every run
+static std::string compiler_identity() {
+    struct stat st;
+    if (stat("/proc/self/exe", &st) < 0) {
+        return "unknown";
+    }
+    return std::to_string(st.st_size) + ':' + std::to_string(st.st_mtime) +
+           '.' + std::to_string(st.st_mtim.tv_nsec);
+}
+
+static bool read_file(const std::string &path, std::string &contents) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    contents.clear();
+    char buffer[64 * 1024];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            close(fd);
+            return false;
+        }
+        contents.append(buffer, n);
+    }
+    close(fd);
+    return true;
+}
+
+static bool write_all(int fd, std::string_view bytes) {
+    while (!bytes.empty()) {
+        ssize_t n = write(fd, bytes.data(), bytes.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return false;
+        }
+        bytes.remove_prefix(n);
+    }
+    return true;
+}
+
+CompileCache::CompileCache(std::string dir, uint64_t max_size)
+    : dir(std::move(dir)), max_size(max_size) {
+    make_directory(this->dir);
+}
+
+std::string CompileCache::key(std::string_view source,
+                              std::string_view flags) {
+    static const std::string identity = compiler_identity();
+    Sha256 hash;
+    // Every part but the last is terminated so parts cannot run together
+    hash.update(CACHE_FORMAT);
+    hash.update(std::string_view("", 1));
+    hash.update(identity);
+    hash.update(std::string_view("", 1));
+    hash.update(flags);
+    hash.update(std::string_view("", 1));
+    hash.update(source);
+    return hash.hex();
+}
+
+// Entries are spread over 256 subdirectories by the first byte of the key
+std::string CompileCache::path(const std::string &key) const {
+    return dir + '/' + key.substr(0, 2) + '/' + key.substr(2);
+}
+
+bool CompileCache::lookup(const std::string &key, std::string &contents) {
+    std::string entry = path(key);
+    bool hit = read_file(entry, contents);
+    if (hit) {
+        utimensat(AT_FDCWD, entry.c_str(), nullptr, 0); // most recently used
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (hit) {
+        counts.hits++;
+        counts.bytes_saved += contents.size();
+    } else {
+        counts.misses++;
+    }
+    return hit;
+}
+
+// A failed store only costs a later miss, so errors are not reported
+void CompileCache::store(const std::string &key, std::string_view contents) {
+    std::string entry = path(key);
+    std::string temp;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        temp = dir + "/tmp." + std::to_string(getpid()) + '.' +
+               std::to_string(temporary++);
+    }
+
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return;
+    }
+    bool written = write_all(fd, contents);
+    close(fd);
+    // Another compile of the same source may have stored the entry since
+    // the lookup. Replacing it leaves the size in use as it was.
+    struct stat st;
+    bool existed = false;
+    if (written) {
+        mkdir((dir + '/' + key.substr(0, 2)).c_str(), 0755);
+        existed = stat(entry.c_str(), &st) == 0;
+        written = rename(temp.c_str(), entry.c_str()) == 0;
+    }
+    if (!written) {
+        unlink(temp.c_str());
+        return;
+    }
+
+    if (!existed) {
+        std::lock_guard<std::mutex> lock(mutex);
+        counts.size += contents.size();
+    }
+}
+
+// Removes entries, oldest mtime first, until at most target bytes are
+// left. Returns the size that is left.
+uint64_t CompileCache::evict(uint64_t target) {
+    struct Entry {
+        std::string path;
+        uint64_t size;
+        struct timespec used;
+    };
+    std::vector<Entry> entries;
+    uint64_t size = 0;
+
+    DIR *top = opendir(dir.c_str());
+    if (!top) {
+        return 0;
+    }
+    while (struct dirent *sub = readdir(top)) {
+        if (strlen(sub->d_name) != 2 || !isxdigit(sub->d_name[0]) ||
+            !isxdigit(sub->d_name[1])) {
+            continue; // ., .., stats and temporary files
+        }
+        std::string subdir = dir + '/' + sub->d_name;
+        DIR *inner = opendir(subdir.c_str());
+        if (!inner) {
+            continue;
+        }
+        while (struct dirent *file = readdir(inner)) {
+            struct stat st;
+            std::string path = subdir + '/' + file->d_name;
+            if (strlen(file->d_name) != 62 || stat(path.c_str(), &st) < 0 ||
+                !S_ISREG(st.st_mode)) {
+                continue;
+            }
+            entries.push_back({path, uint64_t(st.st_size), st.st_mtim});
+            size += st.st_size;
+        }
+        closedir(inner);
+    }
+    closedir(top);
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) {
+                  return a.used.tv_sec != b.used.tv_sec
+                             ? a.used.tv_sec < b.used.tv_sec
+                             : a.used.tv_nsec < b.used.tv_nsec;
+              });
+    for (const Entry &entry : entries) {
+        if (size <= target) {
+            break;
+        }
+        if (unlink(entry.path.c_str()) == 0) {
+            size -= entry.size;
+            counts.evicted++;
+        }
+    }
+    return size;
+}
+
+// The totals live in a small text file that is updated under flock, so
+// concurrent compiler processes do not lose each other's counts
+CacheStats CompileCache::save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    CacheStats totals;
+    std::string stats = dir + "/stats";
+    int fd = open(stats.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return counts;
+    }
+    flock(fd, LOCK_EX);
+
+    std::string text;
+    read_file(stats, text);
+    sscanf(text.c_str(),
+           "hits %" SCNu64 "\nmisses %" SCNu64 "\nbytes_saved %" SCNu64
+           "\nsize %" SCNu64 "\nevicted %" SCNu64 "\n",
+           &totals.hits, &totals.misses, &totals.bytes_saved, &totals.size,
+           &totals.evicted);
+    totals.hits += counts.hits;
+    totals.misses += counts.misses;
+    totals.bytes_saved += counts.bytes_saved;
+    totals.size += counts.size;
+
+    // Evicting down to 90% leaves room for the next few stores
+    if (totals.size > max_size) {
+        counts.evicted = 0;
+        totals.size = evict(max_size / 10 * 9);
+        totals.evicted += counts.evicted;
+    }
+    counts = CacheStats();
+
+    text = "hits " + std::to_string(totals.hits) + "\nmisses " +
+           std::to_string(totals.misses) + "\nbytes_saved " +
+           std::to_string(totals.bytes_saved) + "\nsize " +
+           std::to_string(totals.size) + "\nevicted " +
+           std::to_string(totals.evicted) + '\n';
+    if (ftruncate(fd, 0) == 0) {
+        lseek(fd, 0, SEEK_SET);
+        write_all(fd, text);
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    return totals;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t bytes_saved = 0; // output served from the cache
+    uint64_t size = 0;        // bytes stored, recounted when evicting
+    uint64_t evicted = 0;     // entries removed to stay under the limit
+};
+
+// Compiled outputs on disk, addressed by the SHA-256 of everything that
+// determines them: the compiler binary, the flags and the source bytes.
+// Entries are written to a temporary file and renamed into place, so
+// readers never see a partial entry. A hit refreshes the entry's mtime,
+// which orders entries for least-recently-used eviction. Safe to share
+// between threads, and between processes using the same directory.
+class CompileCache {
+  public:
+    CompileCache(std::string dir, uint64_t max_size);
+
+    static std::string key(std::string_view source, std::string_view flags);
+
+    bool lookup(const std::string &key, std::string &contents);
+    void store(const std::string &key, std::string_view contents);
+
+    // Adds the counts of this process to the totals kept in the cache
+    // directory, evicts the least recently used entries when the cache
+    // is over its size and returns the new totals
+    CacheStats save();
+
+  private:
+    std::string dir;
+    uint64_t max_size;
+    std::mutex mutex; // guards counts and temporary
+    CacheStats counts;
+    uint64_t temporary = 0; // numbers temporary file names
+
+    std::string path(const std::string &key) const;
+    uint64_t evict(uint64_t target);
+};
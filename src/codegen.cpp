@@ -1,109 +1,304 @@
 #include "codegen.hpp"
-#include <sstream>
+#include "assembler/arm64_encoder.hpp"
+#include "regalloc.hpp"
+#include <algorithm>
+#include <elf.h>
+#include <stdexcept>
 
-CodeGenerator::CodeGenerator() {
-    // Initialize code generator
+// AAPCS64: x9-x15 are temporaries and x0-x8 carry arguments, neither
+// survives a call. x19-x28 must be preserved for the caller. x16/x17 are
+// the intra-procedure-call scratch registers and reload spilled values.
+static const RegisterSet arm64_registers = {
+    {9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7, 8},
+    {19, 20, 21, 22, 23, 24, 25, 26, 27, 28},
+    {16, 17},
+};
+
+static const char *condition_names[] = {"eq", "ne", "lt", "le", "gt", "ge"};
+
+static const char *reg(Reg number) {
+    static const char *names[] = {
+        "x0",  "x1",  "x2",  "x3",  "x4",  "x5",  "x6",  "x7",
+        "x8",  "x9",  "x10", "x11", "x12", "x13", "x14", "x15",
+        "x16", "x17", "x18", "x19", "x20", "x21", "x22", "x23",
+        "x24", "x25", "x26", "x27", "x28", "x29", "x30", "sp"};
+    return names[number];
 }
 
-std::string CodeGenerator::visit_binary_expr(Binary *expr) {
-    // Visit left operand
-    std::string left = expr->left->accept(this);
+// Range of the 12-bit unsigned immediate of add, sub and cmp
+static bool fits_imm12(int64_t value) { return value >= 0 && value < 4096; }
 
-    // Visit right operand
-    std::string right = expr->right->accept(this);
+CodeGenerator::CodeGenerator() {
+    // Initialize code generator
+}
 
-    // Generate assembly for binary operation
-    if (expr->oprt.type == PLUS) {
-        emit("    // Binary addition: " + left + " + " + right);
-        emit("    mov x0, #" + left + "       // load left operand");
-        emit("    mov x1, #" + right + "       // load right operand");
-        emit("    add x0, x0, x1        // add x1 to x0");
-        return "x0"; // Result is in x0
+// Materialize an operand in a virtual register
+Reg CodeGenerator::value(const Operand &operand) {
+    switch (operand.kind) {
+    case Operand::IMMEDIATE:
+        return function.emit(MI_MOV_IMM, NO_REG, NO_REG, operand.value);
+    case Operand::REGISTER:
+        return operand.value;
+    default:
+        throw std::runtime_error("Code generation: operand has no value");
     }
-
-    // TODO: Handle other operators (-, *, /, etc.)
-    return "";
 }
 
-std::string CodeGenerator::visit_grouping_expr(Grouping *expr) {
-    (void)expr; // Suppress unused parameter warning
-    // TODO: Generate ARM assembly for grouping expressions
-    return "";
+Operand CodeGenerator::arithmetic(MachineOp op, Operand left, Operand right) {
+    if (right.kind == Operand::IMMEDIATE) {
+        int64_t imm = right.value;
+        if (!fits_imm12(imm) && fits_imm12(-imm)) {
+            op = op == MI_ADD ? MI_SUB : MI_ADD;
+            imm = -imm;
+        }
+        if (fits_imm12(imm)) {
+            return Operand::reg(function.emit(op, value(left), NO_REG, imm));
+        }
+    }
+    Reg lhs = value(left);
+    return Operand::reg(function.emit(op, lhs, value(right)));
 }
 
-std::string CodeGenerator::visit_literal_expr(Literal *expr) {
-    switch (expr->literal_type) {
-    case LT_NUMBER:
-        return std::to_string(expr->number);
-    case LT_STRING:
-        // TODO: Handle string literals
-        return expr->str;
-    case LT_BOOLEAN:
-        return expr->boolean ? "1" : "0";
-    case LT_NIL:
-        return "0";
-    }
-    return "";
+Operand CodeGenerator::compare(Condition cond, Operand left, Operand right) {
+    if (left.kind == Operand::IMMEDIATE && right.kind != Operand::IMMEDIATE) {
+        std::swap(left, right);
+        cond = mirror(cond);
+    }
+    if (right.kind == Operand::IMMEDIATE && fits_imm12(right.value)) {
+        return Operand::reg(function.emit(MI_CMP_SET, value(left), NO_REG,
+                                          right.value, cond));
+    }
+    Reg lhs = value(left);
+    return Operand::reg(
+        function.emit(MI_CMP_SET, lhs, value(right), 0, cond));
 }
 
-std::string CodeGenerator::visit_unary_expr(Unary *expr) {
-    (void)expr; // Suppress unused parameter warning
-    // TODO: Generate ARM assembly for unary expressions
-    return "";
+void CodeGenerator::lower(const IrInstr &instr, Value index) {
+    Operand left = instr.lhs != NO_VALUE ? operands[instr.lhs] : Operand::none();
+    Operand right =
+        instr.rhs != NO_VALUE ? operands[instr.rhs] : Operand::none();
+    Operand &result = operands[index];
+
+    switch (instr.op) {
+    case IR_CONST:
+        result = Operand::immediate(instr.imm);
+        break;
+    case IR_COPY:
+        result = left;
+        break;
+    case IR_ADD:
+        if (left.kind == Operand::IMMEDIATE) {
+            std::swap(left, right);
+        }
+        result = arithmetic(MI_ADD, left, right);
+        break;
+    case IR_SUB:
+        result = arithmetic(MI_SUB, left, right);
+        break;
+    case IR_MUL:
+    case IR_DIV: {
+        Reg lhs = value(left);
+        result = Operand::reg(function.emit(
+            instr.op == IR_MUL ? MI_MUL : MI_SDIV, lhs, value(right)));
+        break;
+    }
+    case IR_NEG:
+        result = Operand::reg(function.emit(MI_NEG, value(left)));
+        break;
+    case IR_NOT:
+        // false, nil and 0 are falsy
+        result = Operand::reg(
+            function.emit(MI_CMP_SET, value(left), NO_REG, 0, COND_EQ));
+        break;
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
+    case IR_GT:
+    case IR_GE:
+        // Comparisons are listed in the same order as the conditions
+        result = compare(Condition(COND_EQ + (instr.op - IR_EQ)), left, right);
+        break;
+    case IR_RET:
+        function.emit(MI_RETURN, value(left));
+        break;
+    }
 }
 
-std::string CodeGenerator::generate(Expression *ast) {
-    // TODO: Main generation entry point
-    generate_prologue();
+MachineFunction CodeGenerator::compile(const IrFunction &ir, bool returns) {
+    function = MachineFunction();
+    function.returns = returns;
+    operands.assign(ir.values.size(), Operand::none());
+    for (const BasicBlock &block : ir.blocks) {
+        for (Value v : block.code) {
+            lower(ir.at(v), v);
+        }
+    }
+    allocate_registers(function, arm64_registers);
+    finish();
+    emitted = function.code.size();
+    return std::move(function);
+}
 
-    // Visit the AST
-    ast->accept(this);
+void CodeGenerator::generate(const IrFunction &ir, AsmWriter &out) {
+    this->out = &out;
+    out.set_directive(AsmWriter::TEXT, ".section __TEXT,__text\n");
+    out.set_directive(AsmWriter::DATA, ".section .data\n");
 
-    generate_epilogue();
+    out.section(AsmWriter::TEXT);
+    out << ".globl _main\n\n";
+    out << "_main:\n";
+    for (const MachineInstr &instr : compile(ir).code) {
+        emit_instruction(instr);
+    }
+}
 
-    return get_assembly();
+ElfImage CodeGenerator::encode(const IrFunction &ir) {
+    return {EM_AARCH64, encode_arm64(compile(ir)), {}};
 }
 
-void CodeGenerator::emit(const std::string &instruction) {
-    assembly_lines.push_back(instruction);
+std::vector<uint8_t> CodeGenerator::encode_function(const IrFunction &ir) {
+    return encode_arm64(compile(ir, true));
 }
 
-void CodeGenerator::emit_data(const std::string &data) {
-    data_section.push_back(data);
+// Adds sp by bytes, which the immediate form takes 12 bits at a time
+static void adjust_stack(std::vector<MachineInstr> &code, MachineOp op,
+                         uint32_t bytes) {
+    if (bytes >> 12) {
+        code.push_back({op, COND_EQ, SP, SP, NO_REG, int64_t(bytes & ~0xfffu)});
+    }
+    if (bytes & 0xfff) {
+        code.push_back({op, COND_EQ, SP, SP, NO_REG, int64_t(bytes & 0xfff)});
+    }
 }
 
-std::string CodeGenerator::get_assembly() {
-    std::stringstream output;
+// Turns the allocated function into code the printer and the encoder map
+// one to one onto instructions: the frame is set up and torn down around
+// the body, the result moves to x0 and wide immediates are split into
+// 16-bit chunks. Spill slots sit at the bottom of the frame, callee-saved
+// registers above.
+void CodeGenerator::finish() {
+    std::vector<MachineInstr> code;
+    code.reserve(function.code.size() + 2 * function.saved.size() + 4);
 
-    // Data section
-    if (!data_section.empty()) {
-        output << ".section .data\n";
-        for (const auto &line : data_section) {
-            output << line << "\n";
-        }
-        output << "\n";
+    adjust_stack(code, MI_SUB, function.frame_size);
+    for (size_t i = 0; i < function.saved.size(); i++) {
+        code.push_back({MI_STORE, COND_EQ, NO_REG, function.saved[i], NO_REG,
+                        int64_t(function.spill_slots + i) * 8});
     }
 
-    // Text section
-    output << ".section __TEXT,__text\n";
-    output << ".globl _main\n\n";
-    output << "_main:\n";
+    for (const MachineInstr &instr : function.code) {
+        if (instr.op == MI_MOV_IMM) {
+            split_immediate(code, instr.dst, instr.imm);
+            continue;
+        }
+        if (instr.op != MI_RETURN) {
+            code.push_back(instr);
+            continue;
+        }
 
-    for (const auto &line : assembly_lines) {
-        output << line << "\n";
+        // The result may live in a callee-saved register
+        if (instr.lhs != 0) {
+            code.push_back({MI_MOV, COND_EQ, 0, instr.lhs, NO_REG, 0});
+        }
+        for (size_t i = 0; i < function.saved.size(); i++) {
+            code.push_back({MI_LOAD, COND_EQ, function.saved[i], NO_REG,
+                            NO_REG, int64_t(function.spill_slots + i) * 8});
+        }
+        adjust_stack(code, MI_ADD, function.frame_size);
+        code.push_back({MI_RETURN, COND_EQ, NO_REG, 0, NO_REG, 0});
     }
+    function.code = std::move(code);
+}
 
-    return output.str();
+// Second operand of add, sub and cmp. Immediates past 12 bits are
+// shifted left by 12.
+void CodeGenerator::emit_source(const MachineInstr &instr) {
+    AsmWriter &out = *this->out;
+    if (instr.rhs != NO_REG) {
+        out << reg(instr.rhs);
+    } else if (instr.imm >> 12) {
+        out << '#' << (instr.imm >> 12) << ", lsl #12";
+    } else {
+        out << '#' << instr.imm;
+    }
 }
 
-void CodeGenerator::generate_prologue() {
-    // TODO: Generate ARM function prologue
+void CodeGenerator::emit_instruction(const MachineInstr &instr) {
+    static const char *names[] = {"mov", "movk", "mov", "add", "sub", "mul",
+                                  "sdiv", "neg", "cmp", "ldr", "str", "mov"};
+    AsmWriter &out = *this->out;
+
+    switch (instr.op) {
+    case MI_MOV_IMM:
+        out << "    mov " << reg(instr.dst) << ", #" << instr.imm << '\n';
+        break;
+    case MI_MOVK: {
+        uint64_t bits = instr.imm;
+        int shift = 16;
+        while (!(bits >> shift & 0xffff)) {
+            shift += 16;
+        }
+        out << "    movk " << reg(instr.dst) << ", #" << (bits >> shift & 0xffff)
+            << ", lsl #" << shift << '\n';
+        break;
+    }
+    case MI_MOV:
+    case MI_NEG:
+        out << "    " << names[instr.op] << ' ' << reg(instr.dst) << ", "
+            << reg(instr.lhs) << '\n';
+        break;
+    case MI_ADD:
+    case MI_SUB:
+    case MI_MUL:
+    case MI_SDIV:
+        out << "    " << names[instr.op] << ' ' << reg(instr.dst) << ", "
+            << reg(instr.lhs) << ", ";
+        emit_source(instr);
+        out << '\n';
+        break;
+    case MI_CMP_SET:
+        out << "    cmp " << reg(instr.lhs) << ", ";
+        emit_source(instr);
+        out << "\n    cset " << reg(instr.dst) << ", "
+            << condition_names[instr.cond] << '\n';
+        break;
+    case MI_LOAD:
+        out << "    ldr " << reg(instr.dst) << ", [sp, #" << instr.imm
+            << "]\n";
+        break;
+    case MI_STORE:
+        out << "    str " << reg(instr.lhs) << ", [sp, #" << instr.imm
+            << "]\n";
+        break;
+    case MI_LEA:
+        throw std::runtime_error("Code generation: lea is not an ARM64 "
+                                 "instruction");
+    case MI_RETURN:
+        out << "    // Program exit\n";
+        out << "    mov x16, #1      // exit syscall\n";
+        out << "    svc #0x80        // system call\n";
+        break;
+    }
 }
 
-void CodeGenerator::generate_epilogue() {
-    // TODO: Generate ARM function epilogue and exit
-    emit("    // Program exit");
-    emit("    mov x0, #0       // exit status");
-    emit("    mov x16, #1      // exit syscall");
-    emit("    svc #0x80        // system call");
-}
\ No newline at end of file
+// mov takes any 16-bit value or its complement, wider values are built
+// 16 bits at a time
+void CodeGenerator::split_immediate(std::vector<MachineInstr> &code, Reg dst,
+                                    int64_t value) {
+    if ((value >= 0 && value < 0x10000) || (value < 0 && ~value < 0x10000)) {
+        code.push_back({MI_MOV_IMM, COND_EQ, dst, NO_REG, NO_REG, value});
+        return;
+    }
+
+    uint64_t bits = value;
+    code.push_back(
+        {MI_MOV_IMM, COND_EQ, dst, NO_REG, NO_REG, int64_t(bits & 0xffff)});
+    for (int shift = 16; shift < 64; shift += 16) {
+        uint64_t chunk = bits & (uint64_t(0xffff) << shift);
+        if (chunk != 0) {
+            code.push_back(
+                {MI_MOVK, COND_EQ, dst, NO_REG, NO_REG, int64_t(chunk)});
+        }
+    }
+}
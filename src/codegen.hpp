@@ -1,32 +1,35 @@
 #pragma once
-#include "parser.hpp"
-#include "visitor.hpp"
+#include "backend.hpp"
+#include "machine.hpp"
 #include <string>
 #include <vector>
 
-class CodeGenerator : public Visitor {
+// Lowers IR to ARM64. Assembly uses the Darwin exit syscall, ELF images
+// the Linux one.
+class CodeGenerator : public Backend {
 private:
-    std::vector<std::string> assembly_lines;
-    std::vector<std::string> data_section;
-    
+    AsmWriter *out = nullptr;
+    MachineFunction function;
+    std::vector<Operand> operands; // lowered location of each IR value
+
 public:
     CodeGenerator();
     
-    // Visitor pattern methods for expressions
-    std::string visit_binary_expr(Binary *expr) override;
-    std::string visit_grouping_expr(Grouping *expr) override;
-    std::string visit_literal_expr(Literal *expr) override;
-    std::string visit_unary_expr(Unary *expr) override;
-    
     // Code generation methods
-    std::string generate(Expression* ast);
-    void emit(const std::string& instruction);
-    void emit_data(const std::string& data);
-    
-    // Get the complete assembly output
-    std::string get_assembly();
-    
+    MachineFunction compile(const IrFunction &ir, bool returns = false);
+    void generate(const IrFunction &ir, AsmWriter &out) override;
+    ElfImage encode(const IrFunction &ir) override;
+    std::vector<uint8_t> encode_function(const IrFunction &ir) override;
+
 private:
-    void generate_prologue();
-    void generate_epilogue();
-}; 
\ No newline at end of file
+    void lower(const IrInstr &instr, Value index);
+    Reg value(const Operand &operand);
+    Operand arithmetic(MachineOp op, Operand left, Operand right);
+    Operand compare(Condition cond, Operand left, Operand right);
+
+    void finish();
+    static void split_immediate(std::vector<MachineInstr> &code, Reg dst,
+                                int64_t value);
+    void emit_source(const MachineInstr &instr);
+    void emit_instruction(const MachineInstr &instr);
+};
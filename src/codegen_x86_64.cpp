@@ -0,0 +1,408 @@
+#include "codegen_x86_64.hpp"
+#include "assembler/x86_64_encoder.hpp"
+#include "regalloc.hpp"
+#include <elf.h>
+#include <limits>
+#include <stdexcept>
+
+typedef X86CodeGenerator::Selected Selected;
+
+enum X86Register : Reg {
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+};
+
+// System V: rax and rdx are taken by idiv and the exit syscall, r10 and
+// r11 reload spilled values. rbx and r12-r15 belong to the caller, rbp is
+// left alone as the frame pointer.
+static const RegisterSet x86_64_registers = {
+    {RCX, RSI, RDI, R8, R9},
+    {RBX, R12, R13, R14, R15},
+    {R10, R11},
+};
+
+static const char *names64[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp",
+                                "rsi", "rdi", "r8",  "r9",  "r10", "r11",
+                                "r12", "r13", "r14", "r15"};
+static const char *names32[] = {"eax", "ecx",  "edx",  "ebx",  "esp",  "ebp",
+                                "esi", "edi",  "r8d",  "r9d",  "r10d", "r11d",
+                                "r12d", "r13d", "r14d", "r15d"};
+static const char *names8[] = {"al",  "cl",  "dl",   "bl",   "spl",  "bpl",
+                               "sil", "dil", "r8b",  "r9b",  "r10b", "r11b",
+                               "r12b", "r13b", "r14b", "r15b"};
+
+static const char *condition_names[] = {"e", "ne", "l", "le", "g", "ge"};
+
+static const char *reg(Reg number) { return names64[number]; }
+
+// Sign-extended 32-bit immediate of most instructions
+static bool fits_imm32(int64_t value) {
+    return value >= std::numeric_limits<int32_t>::min() &&
+           value <= std::numeric_limits<int32_t>::max();
+}
+
+static Selected none() { return {Selected::NONE, 0, 1}; }
+static Selected immediate(int64_t value) {
+    return {Selected::IMMEDIATE, value, 1};
+}
+static Selected registered(Reg reg) { return {Selected::REGISTER, reg, 1}; }
+
+// Materialize an operand in a virtual register
+Reg X86CodeGenerator::value(const Selected &operand) {
+    switch (operand.kind) {
+    case Selected::IMMEDIATE:
+        return function.emit(MI_MOV_IMM, NO_REG, NO_REG, operand.value);
+    case Selected::REGISTER:
+        return operand.value;
+    case Selected::SCALED:
+        return lea(NO_REG, operand.value, operand.scale, 0).value;
+    default:
+        throw std::runtime_error("Code generation: operand has no value");
+    }
+}
+
+Selected X86CodeGenerator::lea(Reg base, Reg index, uint8_t scale,
+                               int64_t disp) {
+    return registered(
+        function.emit(MI_LEA, base, index, disp, COND_EQ, scale));
+}
+
+// base + index * scale + disp covers register plus register, register
+// plus immediate and register plus scaled register in one instruction
+Selected X86CodeGenerator::add(Selected left, Selected right) {
+    if (left.kind == Selected::IMMEDIATE ||
+        (left.kind == Selected::SCALED && right.kind != Selected::IMMEDIATE)) {
+        std::swap(left, right);
+    }
+
+    if (right.kind == Selected::IMMEDIATE && fits_imm32(right.value)) {
+        if (left.kind == Selected::SCALED) {
+            return lea(NO_REG, left.value, left.scale, right.value);
+        }
+        return lea(value(left), NO_REG, 1, right.value);
+    }
+    if (right.kind == Selected::SCALED) {
+        return lea(value(left), right.value, right.scale, 0);
+    }
+    Reg base = value(left);
+    return lea(base, value(right), 1, 0);
+}
+
+Selected X86CodeGenerator::multiply(Selected left, Selected right) {
+    if (left.kind == Selected::IMMEDIATE) {
+        std::swap(left, right);
+    }
+
+    if (right.kind == Selected::IMMEDIATE) {
+        int64_t factor = right.value;
+        Reg reg = value(left);
+        switch (factor) {
+        case 1:
+            return registered(reg);
+        case 2:
+        case 4:
+        case 8:
+            return {Selected::SCALED, reg, uint8_t(factor)};
+        case 3:
+        case 5:
+        case 9:
+            return lea(reg, reg, uint8_t(factor - 1), 0);
+        }
+        if (fits_imm32(factor)) {
+            return registered(function.emit(MI_MUL, reg, NO_REG, factor));
+        }
+        return registered(function.emit(MI_MUL, reg, value(right)));
+    }
+
+    Reg lhs = value(left);
+    return registered(function.emit(MI_MUL, lhs, value(right)));
+}
+
+Selected X86CodeGenerator::compare(Condition cond, Selected left,
+                                   Selected right) {
+    if (left.kind == Selected::IMMEDIATE &&
+        right.kind != Selected::IMMEDIATE) {
+        std::swap(left, right);
+        cond = mirror(cond);
+    }
+    if (right.kind == Selected::IMMEDIATE && fits_imm32(right.value)) {
+        return registered(function.emit(MI_CMP_SET, value(left), NO_REG,
+                                        right.value, cond));
+    }
+    Reg lhs = value(left);
+    return registered(function.emit(MI_CMP_SET, lhs, value(right), 0, cond));
+}
+
+void X86CodeGenerator::lower(const IrInstr &instr, Value index) {
+    Selected left = instr.lhs != NO_VALUE ? operands[instr.lhs] : none();
+    Selected right = instr.rhs != NO_VALUE ? operands[instr.rhs] : none();
+    Selected &result = operands[index];
+
+    switch (instr.op) {
+    case IR_CONST:
+        result = immediate(instr.imm);
+        break;
+    case IR_COPY:
+        result = left;
+        break;
+    case IR_ADD:
+        result = add(left, right);
+        break;
+    case IR_SUB:
+        if (right.kind == Selected::IMMEDIATE && right.value != INT64_MIN &&
+            fits_imm32(-right.value)) {
+            result = add(left, immediate(-right.value));
+            break;
+        }
+        {
+            Reg lhs = value(left);
+            result = registered(function.emit(MI_SUB, lhs, value(right)));
+        }
+        break;
+    case IR_MUL:
+        result = multiply(left, right);
+        break;
+    case IR_DIV: {
+        Reg lhs = value(left);
+        result = registered(function.emit(MI_SDIV, lhs, value(right)));
+        break;
+    }
+    case IR_NEG:
+        result = registered(function.emit(MI_NEG, value(left)));
+        break;
+    case IR_NOT:
+        // false, nil and 0 are falsy
+        result = registered(
+            function.emit(MI_CMP_SET, value(left), NO_REG, 0, COND_EQ));
+        break;
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
+    case IR_GT:
+    case IR_GE:
+        // Comparisons are listed in the same order as the conditions
+        result = compare(Condition(COND_EQ + (instr.op - IR_EQ)), left, right);
+        break;
+    case IR_RET:
+        function.emit(MI_RETURN, value(left));
+        break;
+    }
+}
+
+MachineFunction X86CodeGenerator::compile(const IrFunction &ir,
+                                          bool returns) {
+    function = MachineFunction();
+    function.returns = returns;
+    operands.assign(ir.values.size(), none());
+    for (const BasicBlock &block : ir.blocks) {
+        for (Value v : block.code) {
+            lower(ir.at(v), v);
+        }
+    }
+    allocate_registers(function, x86_64_registers);
+    finish();
+    emitted = function.code.size();
+    return std::move(function);
+}
+
+// Sets up and tears down the frame around the body and moves the result
+// into rdi for the exit syscall, or rax when the function returns. Spill
+// slots sit at the bottom of the frame, callee-saved registers above.
+void X86CodeGenerator::finish() {
+    std::vector<MachineInstr> code;
+    code.reserve(function.code.size() + 2 * function.saved.size() + 4);
+
+    int64_t frame = function.frame_size;
+    if (frame) {
+        code.push_back({MI_SUB, COND_EQ, RSP, RSP, NO_REG, frame});
+    }
+    for (size_t i = 0; i < function.saved.size(); i++) {
+        code.push_back({MI_STORE, COND_EQ, NO_REG, function.saved[i], NO_REG,
+                        int64_t(function.spill_slots + i) * 8});
+    }
+
+    for (const MachineInstr &instr : function.code) {
+        if (instr.op != MI_RETURN) {
+            code.push_back(instr);
+            continue;
+        }
+
+        // The result may live in a callee-saved register
+        Reg result = function.returns ? RAX : RDI;
+        if (instr.lhs != result) {
+            code.push_back({MI_MOV, COND_EQ, result, instr.lhs, NO_REG, 0});
+        }
+        for (size_t i = 0; i < function.saved.size(); i++) {
+            code.push_back({MI_LOAD, COND_EQ, function.saved[i], NO_REG,
+                            NO_REG, int64_t(function.spill_slots + i) * 8});
+        }
+        if (frame) {
+            code.push_back({MI_ADD, COND_EQ, RSP, RSP, NO_REG, frame});
+        }
+        code.push_back({MI_RETURN, COND_EQ, NO_REG, result, NO_REG, 0});
+    }
+    function.code = std::move(code);
+}
+
+void X86CodeGenerator::generate(const IrFunction &ir, AsmWriter &out) {
+    this->out = &out;
+    out.set_directive(AsmWriter::TEXT, ".text\n");
+    out.set_directive(AsmWriter::DATA, ".data\n");
+
+    out.section(AsmWriter::TEXT);
+    out << ".intel_syntax noprefix\n";
+    out << ".globl _start\n\n";
+    out << "_start:\n";
+    for (const MachineInstr &instr : compile(ir).code) {
+        emit_instruction(instr);
+    }
+}
+
+ElfImage X86CodeGenerator::encode(const IrFunction &ir) {
+    return {EM_X86_64, encode_x86_64(compile(ir)), {}};
+}
+
+std::vector<uint8_t> X86CodeGenerator::encode_function(const IrFunction &ir) {
+    return encode_x86_64(compile(ir, true));
+}
+
+// Register or 32-bit immediate second operand
+void X86CodeGenerator::emit_source(const MachineInstr &instr) {
+    if (instr.rhs == NO_REG) {
+        *out << instr.imm;
+    } else {
+        *out << reg(instr.rhs);
+    }
+}
+
+// dst = lhs op rhs with instructions that overwrite their first operand
+void X86CodeGenerator::two_address(const char *name, const MachineInstr &instr,
+                                   bool commutative) {
+    AsmWriter &out = *this->out;
+    const char *dst = reg(instr.dst);
+    if (instr.dst == instr.lhs) {
+        out << "    " << name << ' ' << dst << ", ";
+        emit_source(instr);
+        out << '\n';
+    } else if (instr.dst == instr.rhs && commutative) {
+        out << "    " << name << ' ' << dst << ", " << reg(instr.lhs) << '\n';
+    } else if (instr.dst == instr.rhs) {
+        // lhs - dst == -dst + lhs
+        out << "    neg " << dst << '\n';
+        out << "    add " << dst << ", " << reg(instr.lhs) << '\n';
+    } else {
+        out << "    mov " << dst << ", " << reg(instr.lhs) << '\n';
+        out << "    " << name << ' ' << dst << ", ";
+        emit_source(instr);
+        out << '\n';
+    }
+}
+
+void X86CodeGenerator::emit_instruction(const MachineInstr &instr) {
+    AsmWriter &out = *this->out;
+    switch (instr.op) {
+    case MI_MOV_IMM:
+        // Writing the 32-bit register clears the upper half
+        if (instr.imm >= 0 && instr.imm <= UINT32_MAX) {
+            out << "    mov " << names32[instr.dst] << ", ";
+        } else if (fits_imm32(instr.imm)) {
+            out << "    mov " << reg(instr.dst) << ", ";
+        } else {
+            out << "    movabs " << reg(instr.dst) << ", ";
+        }
+        out << instr.imm << '\n';
+        break;
+    case MI_MOV:
+        out << "    mov " << reg(instr.dst) << ", " << reg(instr.lhs) << '\n';
+        break;
+    case MI_LEA: {
+        out << "    lea " << reg(instr.dst) << ", [";
+        bool empty = true;
+        if (instr.lhs != NO_REG) {
+            out << reg(instr.lhs);
+            empty = false;
+        }
+        if (instr.rhs != NO_REG) {
+            out << (empty ? "" : " + ") << reg(instr.rhs);
+            if (instr.scale != 1) {
+                out << '*' << int(instr.scale);
+            }
+            empty = false;
+        }
+        if (instr.imm < 0) {
+            out << " - " << (0 - uint64_t(instr.imm));
+        } else if (instr.imm > 0 || empty) {
+            out << (empty ? "" : " + ") << instr.imm;
+        }
+        out << "]\n";
+        break;
+    }
+    case MI_ADD:
+        two_address("add", instr, true);
+        break;
+    case MI_SUB:
+        two_address("sub", instr, false);
+        break;
+    case MI_MUL:
+        if (instr.rhs == NO_REG) {
+            out << "    imul " << reg(instr.dst) << ", " << reg(instr.lhs)
+                << ", " << instr.imm << '\n';
+        } else {
+            two_address("imul", instr, true);
+        }
+        break;
+    case MI_SDIV:
+        // rdx:rax / rhs, neither is ever allocated
+        out << "    mov rax, " << reg(instr.lhs) << '\n';
+        out << "    cqo\n";
+        out << "    idiv " << reg(instr.rhs) << '\n';
+        out << "    mov " << reg(instr.dst) << ", rax\n";
+        break;
+    case MI_NEG:
+        if (instr.dst != instr.lhs) {
+            out << "    mov " << reg(instr.dst) << ", " << reg(instr.lhs)
+                << '\n';
+        }
+        out << "    neg " << reg(instr.dst) << '\n';
+        break;
+    case MI_CMP_SET:
+        out << "    cmp " << reg(instr.lhs) << ", ";
+        emit_source(instr);
+        out << "\n    set" << condition_names[instr.cond] << ' '
+            << names8[instr.dst] << '\n';
+        out << "    movzx " << names32[instr.dst] << ", " << names8[instr.dst]
+            << '\n';
+        break;
+    case MI_LOAD:
+        out << "    mov " << reg(instr.dst) << ", qword ptr [rsp + "
+            << instr.imm << "]\n";
+        break;
+    case MI_STORE:
+        out << "    mov qword ptr [rsp + " << instr.imm << "], "
+            << reg(instr.lhs) << '\n';
+        break;
+    case MI_RETURN:
+        out << "    # Program exit\n";
+        out << "    mov eax, 60       # exit syscall\n";
+        out << "    syscall\n";
+        break;
+    case MI_MOVK:
+        throw std::runtime_error("Code generation: movk is not an x86-64 "
+                                 "instruction");
+    }
+}
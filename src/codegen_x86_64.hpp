@@ -0,0 +1,44 @@
+#pragma once
+#include "backend.hpp"
+#include "machine.hpp"
+#include <string>
+#include <vector>
+
+// Lowers IR to x86-64 for Linux. Instructions are picked by pattern:
+// additions and multiplications by 2, 4 or 8 become lea, immediates stay
+// in the instruction that uses them and comparisons set flags for setcc.
+class X86CodeGenerator : public Backend {
+  public:
+    // An IR value during selection. Products by 2, 4 or 8 are kept as a
+    // scaled register until a user either folds them into its lea or
+    // needs them in a register.
+    struct Selected {
+        enum Kind { NONE, IMMEDIATE, REGISTER, SCALED };
+        Kind kind;
+        int64_t value; // immediate value or virtual register
+        uint8_t scale;
+    };
+
+    MachineFunction compile(const IrFunction &ir, bool returns = false);
+    void generate(const IrFunction &ir, AsmWriter &out) override;
+    ElfImage encode(const IrFunction &ir) override;
+    std::vector<uint8_t> encode_function(const IrFunction &ir) override;
+
+  private:
+    MachineFunction function;
+    std::vector<Selected> operands; // lowered location of each IR value
+    AsmWriter *out = nullptr;
+
+    void lower(const IrInstr &instr, Value index);
+    Reg value(const Selected &operand);
+    Selected lea(Reg base, Reg index, uint8_t scale, int64_t disp);
+    Selected add(Selected left, Selected right);
+    Selected multiply(Selected left, Selected right);
+    Selected compare(Condition cond, Selected left, Selected right);
+    void finish();
+
+    void emit_source(const MachineInstr &instr);
+    void emit_instruction(const MachineInstr &instr);
+    void two_address(const char *name, const MachineInstr &instr,
+                     bool commutative);
+};
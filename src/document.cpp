@@ -0,0 +1,383 @@
+#include "document.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "token_source.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+// Strings are stored without their quotes, the lexer consumed them anyway
+static uint64_t lexeme_start(const TokenStream &tokens, size_t i) {
+    return tokens.offsets[i] - (tokens.types[i] == STRING);
+}
+
+static uint64_t lexeme_end(const TokenStream &tokens, size_t i) {
+    return tokens.offsets[i] + tokens.lengths[i] + (tokens.types[i] == STRING);
+}
+
+static int child_count(NodeTag tag) {
+    switch (tag) {
+    case NODE_BINARY:
+        return 2;
+    case NODE_GROUPING:
+    case NODE_UNARY:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+Document::Document(std::string text) : source(std::move(text)) { reload(); }
+
+EditStats Document::reload() {
+    EditStats stats;
+    stats.full_parse = true;
+    message.clear();
+    lexed = false;
+    stream = TokenStream();
+
+    std::ostringstream diagnostics;
+    try {
+        stream = lex(source, interner, diagnostics);
+    } catch (const std::exception &e) {
+        message = diagnostics.str() + e.what();
+        tree = Ast();
+        index_nodes();
+        return stats;
+    }
+    lexed = true;
+    stats.tokens_relexed = stream.size();
+    parse_all(stats);
+    return stats;
+}
+
+void Document::parse_all(EditStats &stats) {
+    stats.full_parse = true;
+    message.clear();
+    tree = Ast();
+    tree.interner = &interner;
+    try {
+        StreamSource tokens(stream);
+        Parser parser;
+        parser.parse(tokens, tree);
+        stats.nodes_reparsed = tree.nodes.size();
+    } catch (const std::exception &e) {
+        message = e.what();
+        tree = Ast();
+    }
+    index_nodes();
+}
+
+EditStats Document::edit(uint64_t offset, uint64_t removed,
+                         std::string_view inserted) {
+    if (offset > source.size() || removed > source.size() - offset) {
+        throw std::out_of_range("Edit outside the document");
+    }
+    if (!lexed) {
+        source.replace(offset, removed, inserted);
+        return reload();
+    }
+
+    EditStats stats;
+    int64_t shift = int64_t(inserted.size()) - int64_t(removed);
+    uint64_t edit_end = offset + removed;
+    size_t count = stream.size();
+
+    // The lexer reads up to two bytes past the end of a token, so tokens
+    // ending just before the edit may lex differently now
+    size_t first = std::lower_bound(stream.offsets.begin(),
+                                    stream.offsets.end(), offset) -
+                   stream.offsets.begin();
+    while (first > 0 && lexeme_end(stream, first - 1) + 1 >= offset) {
+        first--;
+    }
+    uint64_t resume = first > 0 ? lexeme_end(stream, first - 1) : 0;
+
+    // Old tokens from kept on lie after the edit. They are reused as soon as
+    // the lexer starts a token where one of them starts.
+    size_t kept = first;
+    while (kept < count && lexeme_start(stream, kept) < edit_end) {
+        kept++;
+    }
+    std::vector<std::string> edited;
+    for (size_t i = first; i < kept; i++) {
+        edited.emplace_back(stream.at(i).text);
+    }
+    size_t edited_end = kept;
+
+    source.replace(offset, removed, inserted);
+    stream.source = source;
+
+    TokenStream fresh;
+    fresh.source = source;
+    fresh.interner = &interner;
+    Lexer lexer;
+    std::ostringstream diagnostics;
+    init_lexer(&lexer, source, interner, diagnostics);
+    lexer.current = resume;
+    bool synced = false;
+    try {
+        while (next_token(&lexer)) {
+            int64_t start = lexer.start;
+            while (kept < count &&
+                   int64_t(lexeme_start(stream, kept)) + shift < start) {
+                kept++;
+            }
+            if (kept < count &&
+                int64_t(lexeme_start(stream, kept)) + shift == start) {
+                synced = true;
+                break;
+            }
+            fresh.push(lexer.token.type,
+                       lexer.token.text.data() - source.data(),
+                       lexer.token.text.size(), lexer.token.id);
+        }
+    } catch (const std::exception &) {
+    }
+    if (lexer.encountered_error) {
+        // Let a full pass report every error with its position
+        return reload();
+    }
+    if (!synced) {
+        kept = count;
+    }
+
+    size_t dropped = kept - first;
+    stats.tokens_relexed = fresh.size();
+    stats.tokens_shifted = count - kept;
+
+    // Only the spelling of a token reaches the tree, so a token that reads
+    // the same leaves every node as it was
+    bool same = fresh.size() == dropped;
+    for (size_t i = 0; same && i < dropped; i++) {
+        size_t old = first + i;
+        std::string_view text =
+            old < edited_end
+                ? std::string_view(edited[i])
+                : std::string_view(source).substr(stream.offsets[old] + shift,
+                                                  stream.lengths[old]);
+        same = fresh.types[i] == stream.types[old] && fresh.at(i).text == text;
+    }
+    stream.splice(first, dropped, fresh, shift);
+    if (same) {
+        return stats;
+    }
+    if (!valid()) {
+        parse_all(stats);
+        return stats;
+    }
+
+    // Subtrees around the replaced tokens, from the root down. With no
+    // replaced token they have to hold tokens on both sides.
+    auto covers = [&](NodeIndex i) {
+        uint32_t a = first_tokens[i];
+        uint32_t b = last_tokens[i];
+        return dropped > 0 ? a <= first && kept - 1 <= b
+                           : a < first && first <= b;
+    };
+    std::vector<NodeIndex> path;
+    for (NodeIndex i = tree.root; covers(i);) {
+        path.push_back(i);
+        const Node &n = tree.at(i);
+        int children = child_count(n.tag);
+        if (children > 0 && covers(n.lhs)) {
+            i = n.lhs;
+        } else if (children > 1 && covers(n.rhs)) {
+            i = n.rhs;
+        } else {
+            break;
+        }
+    }
+
+    // The smallest one that a parser call of its own builds and that still
+    // parses on its own, the root is left to a full parse
+    int64_t token_shift = int64_t(fresh.size()) - int64_t(dropped);
+    for (size_t depth = path.size(); depth-- > 1;) {
+        NodeIndex node = path[depth];
+        uint8_t power;
+        if (!operand_power(tree.at(path[depth - 1]), node, power)) {
+            continue;
+        }
+        Ast piece;
+        piece.interner = &interner;
+        try {
+            Parser parser;
+            parser.parse_range(stream, first_tokens[node],
+                               last_tokens[node] + token_shift + 1, power,
+                               piece);
+        } catch (const std::exception &) {
+            // The change reaches past this subtree
+            continue;
+        }
+        stats.nodes_reparsed = piece.nodes.size();
+        replace(node, piece, kept, token_shift);
+        return stats;
+    }
+
+    parse_all(stats);
+    return stats;
+}
+
+void Document::index_nodes() {
+    first_tokens.resize(tree.nodes.size());
+    last_tokens.resize(tree.nodes.size());
+    index_nodes(tree, 0, first_tokens.data(), last_tokens.data());
+}
+
+// Token spans of nodes [from, end) of ast, written from index from on.
+// Children come before their parents.
+void Document::index_nodes(const Ast &ast, NodeIndex from,
+                           uint32_t *first_tokens, uint32_t *last_tokens) {
+    for (NodeIndex i = from; i < ast.nodes.size(); i++) {
+        const Node &node = ast.nodes[i];
+        switch (node.tag) {
+        case NODE_BINARY:
+            first_tokens[i] = first_tokens[node.lhs];
+            last_tokens[i] = last_tokens[node.rhs];
+            break;
+        case NODE_UNARY:
+            first_tokens[i] = node.main_token;
+            last_tokens[i] = last_tokens[node.lhs];
+            break;
+        case NODE_GROUPING:
+            first_tokens[i] = node.main_token;
+            last_tokens[i] = last_tokens[node.lhs] + 1; // the ')'
+            break;
+        default:
+            first_tokens[i] = node.main_token;
+            last_tokens[i] = node.main_token;
+        }
+    }
+}
+
+// Whether the parser builds node, a child of parent, in a call of its own,
+// the right operand of an infix operator, the operand of a prefix one or
+// the inside of a grouping, and the binding power of that call
+bool Document::operand_power(const Node &parent, NodeIndex node,
+                             uint8_t &power) {
+    switch (parent.tag) {
+    case NODE_BINARY:
+        power = infix_operand_power(parent.oprt);
+        return parent.rhs == node;
+    case NODE_UNARY:
+        power = prefix_operand_power();
+        return true;
+    case NODE_GROUPING:
+        power = 0;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Swaps the subtree of node for piece, whose root is its last node. Tokens
+// from tokens_end on, counted before the edit, moved by token_shift.
+void Document::replace(NodeIndex node, const Ast &piece, uint32_t tokens_end,
+                       int64_t token_shift) {
+    // A subtree is the range of nodes added while the parser built it, so it
+    // starts at its first added leaf
+    NodeIndex first = node;
+    while (child_count(tree.nodes[first].tag) > 0) {
+        first = tree.nodes[first].lhs;
+    }
+    uint32_t span_end = last_tokens[node];
+
+    // Numbers keep their payloads in extra in node order, two words each
+    uint32_t slot = 0;
+    for (NodeIndex i = first; i-- > 0;) {
+        if (tree.nodes[i].tag == NODE_NUMBER) {
+            slot = tree.nodes[i].lhs + 2;
+            break;
+        }
+    }
+    uint32_t slots = 0;
+    for (NodeIndex i = first; i <= node; i++) {
+        slots += tree.nodes[i].tag == NODE_NUMBER ? 2 : 0;
+    }
+    splice(tree.extra, slot, slots, piece.extra.begin(), piece.extra.end());
+    int64_t slot_shift = int64_t(piece.extra.size()) - slots;
+
+    std::vector<uint32_t> piece_first(piece.nodes.size());
+    std::vector<uint32_t> piece_last(piece.nodes.size());
+    index_nodes(piece, 0, piece_first.data(), piece_last.data());
+    size_t count = node - first + 1;
+    splice(tree.nodes, first, count, piece.nodes.begin(), piece.nodes.end());
+    splice(first_tokens, first, count, piece_first.begin(), piece_first.end());
+    splice(last_tokens, first, count, piece_last.begin(), piece_last.end());
+    int64_t node_shift = int64_t(piece.nodes.size()) - count;
+    NodeIndex root = first + piece.nodes.size() - 1;
+
+    NodeIndex after = first + piece.nodes.size();
+    for (NodeIndex i = first; i < after; i++) {
+        Node &n = tree.nodes[i];
+        if (n.tag == NODE_NUMBER) {
+            n.lhs += slot;
+        }
+        int children = child_count(n.tag);
+        if (children > 0) {
+            n.lhs += first;
+        }
+        if (children > 1) {
+            n.rhs += first;
+        }
+    }
+
+    // Only node itself is referred to from outside its subtree. Of the
+    // nodes after it, the ones around it end with its last token.
+    auto moved = [&](NodeIndex index) -> NodeIndex {
+        if (index == node) {
+            return root;
+        }
+        return index > node ? index + node_shift : index;
+    };
+    for (NodeIndex i = after; i < tree.nodes.size(); i++) {
+        Node &n = tree.nodes[i];
+        if (n.tag == NODE_NUMBER) {
+            n.lhs += slot_shift;
+        }
+        int children = child_count(n.tag);
+        if (children > 0) {
+            n.lhs = moved(n.lhs);
+        }
+        if (children > 1) {
+            n.rhs = moved(n.rhs);
+        }
+        if (n.main_token >= tokens_end) {
+            n.main_token += token_shift;
+        }
+        if (first_tokens[i] > span_end) {
+            first_tokens[i] += token_shift;
+        }
+        if (last_tokens[i] >= span_end) {
+            last_tokens[i] += token_shift;
+        }
+    }
+    tree.root = moved(tree.root);
+}
+
+bool Document::matches(const Document &other) const {
+    const TokenStream &x = stream;
+    const TokenStream &y = other.stream;
+    if (message != other.message || x.types != y.types ||
+        x.offsets != y.offsets || x.lengths != y.lengths) {
+        return false;
+    }
+    const Ast &p = tree;
+    const Ast &q = other.tree;
+    if (p.nodes.size() != q.nodes.size() || p.extra != q.extra ||
+        p.root != q.root) {
+        return false;
+    }
+    for (NodeIndex i = 0; i < p.nodes.size(); i++) {
+        const Node &m = p.nodes[i];
+        const Node &n = q.nodes[i];
+        bool lhs = m.tag == NODE_STRING ? p.string(i) == q.string(i)
+                                        : m.lhs == n.lhs;
+        if (m.tag != n.tag || m.oprt != n.oprt ||
+            m.main_token != n.main_token || !lhs || m.rhs != n.rhs) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "ast.hpp"
+#include "token_stream.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// What one edit cost
+struct EditStats {
+    size_t tokens_relexed = 0; // tokens produced by the lexer
+    size_t tokens_shifted = 0; // later tokens that only moved
+    size_t nodes_reparsed = 0; // nodes produced by the parser
+    bool full_parse = false;   // no smaller subtree could be re-parsed
+};
+
+// A source text kept lexed and parsed across edits. An edit re-lexes from
+// the last token that could have seen the edited bytes until the lexer
+// lines up with an old token again, and re-parses the smallest subtree
+// around the changed tokens that the parser builds in one call.
+//
+// Parse and lexer errors are recorded instead of thrown, the document then
+// has no tree until an edit makes the text valid again.
+class Document {
+  public:
+    explicit Document(std::string text);
+
+    Document(const Document &) = delete;
+    Document &operator=(const Document &) = delete;
+
+    // Replaces removed bytes at offset with inserted
+    EditStats edit(uint64_t offset, uint64_t removed, std::string_view inserted);
+
+    const std::string &text() const { return source; }
+    const TokenStream &tokens() const { return stream; }
+    const Ast &ast() const { return tree; }
+    const std::string &error() const { return message; }
+    bool valid() const { return message.empty(); }
+
+    // Same tokens, error and node table as other, string ids aside. Checks
+    // an edited document against a fresh one of the same text.
+    bool matches(const Document &other) const;
+
+  private:
+    std::string source;
+    Interner interner;
+    TokenStream stream;
+    Ast tree;
+    std::string message;
+    bool lexed = false; // stream holds the tokens of source
+
+    // First and last token of every node of tree
+    std::vector<uint32_t> first_tokens;
+    std::vector<uint32_t> last_tokens;
+
+    EditStats reload();
+    void parse_all(EditStats &stats);
+    void index_nodes();
+    static void index_nodes(const Ast &ast, NodeIndex from,
+                            uint32_t *first_tokens, uint32_t *last_tokens);
+    static bool operand_power(const Node &parent, NodeIndex node,
+                              uint8_t &power);
+    void replace(NodeIndex node, const Ast &piece, uint32_t tokens_end,
+                 int64_t token_shift);
+};
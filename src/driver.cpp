@@ -0,0 +1,278 @@
+#include "driver.hpp"
+#include "asm_writer.hpp"
+#include "backend.hpp"
+#include "cache.hpp"
+#include "libko.hpp"
+#include "profile.hpp"
+#include "source_buffer.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+
+// Whether anything is printed on the way to the output
+static bool prints(const Options &options) {
+    return options.print_parser || options.print_folded || options.print_ir ||
+           options.print_bytecode || options.fold_stats;
+}
+
+// Only the output file can come from the cache, anything printed on the
+// way needs the pipeline to run
+static bool cacheable(const Options &options) {
+    return options.cache && options.output_assembly && !options.jit &&
+           !options.run && !prints(options);
+}
+
+// Flags that change the output, part of the cache key
+static std::string output_flags(const Options &options) {
+    return "target=" + options.target + ";emit=" + options.emit +
+           ";fold=" + (options.fold ? "1" : "0");
+}
+
+bool apply_unit_flag(const std::string &flag, Options &options) {
+    if (flag == "--print=parser") {
+        options.print_parser = true;
+    } else if (flag == "--print=folded") {
+        options.print_folded = true;
+    } else if (flag == "--print=ir") {
+        options.print_ir = true;
+    } else if (flag == "--print=bytecode") {
+        options.print_bytecode = true;
+    } else if (flag == "--no-fold") {
+        options.fold = false;
+    } else if (flag == "--fold-stats") {
+        options.fold_stats = true;
+    } else if (flag == "--emit=asm" || flag == "--emit=obj" ||
+               flag == "--emit=exe") {
+        options.emit = flag.substr(7);
+    } else if (flag.rfind("--target=", 0) == 0) {
+        if (!make_backend(flag.substr(9))) {
+            throw std::runtime_error("Unknown target: " + flag.substr(9));
+        }
+        options.target = flag.substr(9);
+    } else if (flag.rfind("--lex-threads=", 0) == 0) {
+        std::string count = flag.substr(14);
+        options.lex_threads = std::atoi(count.c_str());
+        if (options.lex_threads == 0 ||
+            count.find_first_not_of("0123456789") != std::string::npos) {
+            throw std::runtime_error("Invalid thread count: " + count);
+        }
+    } else if (flag == "--no-assembly") {
+        options.output_assembly = false;
+    } else if (flag == "--jit") {
+        options.jit = true;
+    } else if (flag == "--run") {
+        options.run = true;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Sources this large are worth lexing on every core
+const size_t PARALLEL_LEX_MIN = 1 << 20;
+
+static unsigned lex_chunks(size_t size, const Options &options) {
+    if (options.lex_threads > 0) {
+        return options.lex_threads;
+    }
+    if (size < PARALLEL_LEX_MIN) {
+        return 1;
+    }
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// Writes an output to its file, or to stdout when path is empty. Captured
+// stdout output goes to out.
+static void write_output(const std::string &path, std::string_view bytes,
+                         mode_t mode, const Options &options,
+                         std::ostream &out) {
+    if (path.empty() && options.capture_output) {
+        out.write(bytes.data(), bytes.size());
+        return;
+    }
+    int fd = STDOUT_FILENO;
+    if (!path.empty()) {
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open " + path + ": " +
+                                     strerror(errno));
+        }
+    }
+    while (!bytes.empty()) {
+        ssize_t n = write(fd, bytes.data(), bytes.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            int error = errno;
+            if (fd != STDOUT_FILENO) {
+                close(fd);
+            }
+            throw std::runtime_error("Cannot write " +
+                                     (path.empty() ? "stdout" : path) + ": " +
+                                     strerror(error));
+        }
+        bytes.remove_prefix(n);
+    }
+    if (fd != STDOUT_FILENO) {
+        close(fd);
+    }
+}
+
+// The library's options for one unit, with the lexer threads picked for
+// the source's size
+static ko::Options library_options(size_t size, const Options &options) {
+    ko::Options unit;
+    unit.print_parser = options.print_parser;
+    unit.print_folded = options.print_folded;
+    unit.print_ir = options.print_ir;
+    unit.print_bytecode = options.print_bytecode;
+    unit.fold = options.fold;
+    unit.output_assembly = options.output_assembly;
+    unit.jit = options.jit;
+    unit.run = options.run;
+    unit.emit = options.emit;
+    unit.target = options.target;
+    unit.lex_threads = lex_chunks(size, options);
+    return unit;
+}
+
+static int compile(std::string_view source, const Options &options,
+                   std::ostream &out, std::ostream &err, PhaseTimer &timer);
+
+int compile_unit(const std::string &filename, const Options &options,
+                 std::ostream &out, std::ostream &err) {
+    PhaseTimer timer(options.time_phases, options.trace, filename);
+    debug_print("Reading file");
+    timer.begin("read_file");
+    SourceBuffer source;
+    try {
+        source = SourceBuffer(filename);
+    } catch (std::exception &e) {
+        out << e.what() << std::endl;
+        timer.finish(EXIT_FAILURE, err);
+        return EXIT_FAILURE;
+    }
+    timer.end().bytes = source.view().size();
+
+    int status = compile(source.view(), options, out, err, timer);
+    timer.finish(status, err);
+    return status;
+}
+
+int compile_source(std::string_view source, const Options &options,
+                   std::ostream &out, std::ostream &err) {
+    PhaseTimer timer(options.time_phases, options.trace, "<source>");
+    int status = compile(source, options, out, err, timer);
+    timer.finish(status, err);
+    return status;
+}
+
+static int compile(std::string_view source, const Options &options,
+                   std::ostream &out, std::ostream &err, PhaseTimer &timer) {
+    // Where the output goes and with which permissions
+    std::string output = options.output;
+    mode_t mode = 0644;
+    if (options.emit != "asm" && output.empty() && !options.capture_output) {
+        output = options.emit == "exe" ? "a.out" : "a.o";
+    }
+    if (options.emit == "exe") {
+        mode = 0755;
+    }
+
+    std::string key;
+    if (cacheable(options)) {
+        debug_print("Look up cache");
+        timer.begin("cache");
+        key = CompileCache::key(source, output_flags(options));
+        std::string contents;
+        bool hit = options.cache->lookup(key, contents);
+        timer.end().bytes = hit ? contents.size() : 0;
+        if (hit) {
+            out.flush();
+            try {
+                write_output(output, contents, mode, options, out);
+            } catch (std::exception &e) {
+                out << e.what() << std::endl;
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+    }
+
+    ko::Hooks hooks;
+    hooks.timer = &timer;
+    // Assembly nothing is printed ahead of is written as it is generated.
+    // The file is only opened once the program got that far.
+    int fd = -1;
+    if (key.empty() && options.emit == "asm" && !prints(options) &&
+        !(output.empty() && options.capture_output)) {
+        hooks.assembly = [&]() {
+            out.flush();
+            fd = STDOUT_FILENO;
+            if (!output.empty()) {
+                fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+                if (fd < 0) {
+                    throw std::runtime_error("Cannot open " + output + ": " +
+                                             strerror(errno));
+                }
+            }
+            return std::make_unique<AsmWriter>(fd);
+        };
+    }
+
+    ko::Result result =
+        ko::compile(source, library_options(source.size(), options), hooks);
+    if (fd >= 0 && fd != STDOUT_FILENO) {
+        close(fd);
+    }
+
+    out << result.ast;
+    if (options.fold_stats && result.fold_stats.nodes_before > 0) {
+        err << "Constant folding removed " << result.fold_stats.removed()
+            << " of " << result.fold_stats.nodes_before << " nodes"
+            << std::endl;
+    }
+    out << result.folded << result.bytecode << result.ir;
+    for (const ko::Diagnostic &diagnostic : result.diagnostics) {
+        out << diagnostic.message << std::endl;
+    }
+    if (!result.diagnostics.empty()) {
+        // Only when lexer errors alone stopped the compilation
+        if (std::all_of(result.diagnostics.begin(), result.diagnostics.end(),
+                        [](const ko::Diagnostic &diagnostic) {
+                            return std::string(diagnostic.phase) == "lex";
+                        })) {
+            out << "Lexer error encountered. Terminating compilation"
+                << std::endl;
+        }
+        return EXIT_FAILURE;
+    }
+    if (options.run || options.jit || !options.output_assembly ||
+        hooks.assembly) {
+        return result.status;
+    }
+
+    std::string_view contents = result.assembly;
+    if (options.emit != "asm") {
+        contents = std::string_view(
+            reinterpret_cast<const char *>(result.binary.data()),
+            result.binary.size());
+    }
+    try {
+        if (!key.empty()) {
+            debug_print("Store output in the cache");
+            options.cache->store(key, std::string(contents));
+        }
+        out.flush();
+        write_output(output, contents, mode, options, out);
+    } catch (std::exception &e) {
+        out << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+class CompileCache;
+class Trace;
+
+// Command line settings, shared read-only by every unit of a run
+struct Options {
+    bool print_parser = false;
+    bool print_folded = false;
+    bool print_ir = false;
+    bool print_bytecode = false;
+    bool fold = true;
+    bool fold_stats = false;
+    bool output_assembly = true;
+    bool jit = false;
+    bool run = false;
+    std::string emit = "asm"; // asm, obj or exe
+    std::string output;       // assembly goes to stdout when empty
+    std::string target = "arm64";
+    // Threads a source is lexed on, 0 picks one per core for large sources
+    unsigned lex_threads = 1;
+    CompileCache *cache = nullptr; // reuse outputs of earlier runs
+    // Output meant for stdout goes to the unit's out stream instead, for
+    // callers that hand it on, like the server. So do objects and
+    // executables when no output file is given.
+    bool capture_output = false;
+    bool time_phases = false; // per-phase counts go to err
+    Trace *trace = nullptr;   // collects phase and unit spans
+};
+
+// Applies a flag that only concerns how one unit is compiled. Returns
+// false for any other flag, throws for an unknown target.
+bool apply_unit_flag(const std::string &flag, Options &options);
+
+// Compiles one source file with its own lexer, parser and backend, so
+// units can be compiled on different threads at once. Printed trees and
+// diagnostics go to out, statistics to err. Returns the exit status,
+// which is the program's result for --jit and --run. With a cache, an
+// output that only depends on the source and flags is looked up before
+// lexing and stored after code generation.
+int compile_unit(const std::string &filename, const Options &options,
+                 std::ostream &out, std::ostream &err);
+
+// Compiles source text the way compile_unit compiles a file
+int compile_source(std::string_view source, const Options &options,
+                   std::ostream &out, std::ostream &err);
@@ -0,0 +1,227 @@
+#include "fold.hpp"
+#include <limits>
+
+static Folded constant(NodeTag tag, int64_t value, uint32_t main_token) {
+    return {true, tag, value, 0, main_token};
+}
+
+static Folded boolean(bool value, uint32_t main_token) {
+    return constant(NODE_BOOLEAN, value, main_token);
+}
+
+static Folded number(uint64_t value, uint32_t main_token) {
+    // Two's complement wrap around, like the generated code
+    return constant(NODE_NUMBER, static_cast<int64_t>(value), main_token);
+}
+
+static bool is_number(const Folded &folded, int64_t value) {
+    return folded.constant && folded.tag == NODE_NUMBER &&
+           folded.value == value;
+}
+
+Ast ConstantFolder::fold(const Ast &ast, FoldStats *stats) {
+    this->ast = &ast;
+    out = Ast();
+    out.interner = ast.interner;
+    out.nodes.reserve(ast.nodes.size());
+    out.root = materialize(visit(ast.root));
+
+    if (stats) {
+        stats->nodes_before = ast.nodes.size();
+        stats->nodes_after = out.nodes.size();
+    }
+    return std::move(out);
+}
+
+NodeIndex ConstantFolder::materialize(const Folded &folded) {
+    if (!folded.constant) {
+        return folded.node;
+    }
+
+    switch (folded.tag) {
+    case NODE_NUMBER:
+        return out.add_number(folded.main_token, folded.value);
+    case NODE_STRING:
+        return out.add(NODE_STRING, STRING, folded.main_token, folded.value, 0);
+    case NODE_BOOLEAN:
+        return out.add(NODE_BOOLEAN, folded.value ? TRUE : FALSE,
+                       folded.main_token, folded.value, 0);
+    default:
+        return out.add(NODE_NIL, _NULL, folded.main_token, 0, 0);
+    }
+}
+
+Folded ConstantFolder::visit_literal_expr(NodeIndex index) {
+    const Node &node = ast->at(index);
+    int64_t value = node.tag == NODE_NUMBER ? ast->number(index) : node.lhs;
+    return constant(node.tag, value, node.main_token);
+}
+
+Folded ConstantFolder::visit_grouping_expr(NodeIndex index) {
+    // Precedence is already encoded in the shape of the tree
+    return visit(ast->at(index).lhs);
+}
+
+Folded ConstantFolder::visit_unary_expr(NodeIndex index) {
+    const Node &node = ast->at(index);
+    Folded operand = visit(node.lhs);
+
+    if (operand.constant) {
+        if (node.oprt == MINUS && operand.tag == NODE_NUMBER) {
+            return number(0 - static_cast<uint64_t>(operand.value),
+                          node.main_token);
+        }
+        if (node.oprt == BANG && operand.tag != NODE_STRING) {
+            // false, nil and 0 are falsy
+            return boolean(operand.value == 0, node.main_token);
+        }
+    }
+
+    NodeIndex folded = materialize(operand);
+    Folded result = {};
+    result.node = out.add(NODE_UNARY, node.oprt, node.main_token, folded, 0);
+    result.may_trap = operand.may_trap;
+    return result;
+}
+
+Folded ConstantFolder::visit_binary_expr(NodeIndex index) {
+    const Node &node = ast->at(index);
+    // Everything the operands write past this point can be dropped again
+    size_t nodes_mark = out.nodes.size();
+    size_t extra_mark = out.extra.size();
+
+    Folded left = visit(node.lhs);
+    Folded right = visit(node.rhs);
+
+    Folded result;
+    if (fold_constants(node.oprt, left, right, &result) ||
+        simplify(node.oprt, left, right, &result)) {
+        if (result.constant) {
+            result.main_token = node.main_token;
+            out.nodes.resize(nodes_mark);
+            out.extra.resize(extra_mark);
+        }
+        return result;
+    }
+
+    NodeIndex lhs = materialize(left);
+    NodeIndex rhs = materialize(right);
+    result = {};
+    result.node = out.add(NODE_BINARY, node.oprt, node.main_token, lhs, rhs);
+    bool safe_divisor = right.constant && right.tag == NODE_NUMBER &&
+                        right.value != 0;
+    result.may_trap = left.may_trap || right.may_trap ||
+                      (node.oprt == SLASH && !safe_divisor);
+    return result;
+}
+
+// Both operands are literals
+bool ConstantFolder::fold_constants(TokenType oprt, const Folded &left,
+                                    const Folded &right, Folded *result) {
+    if (!left.constant || !right.constant) {
+        return false;
+    }
+
+    if (oprt == EQUAL_EQUAL || oprt == BANG_EQUAL) {
+        // Literals of different kinds are left for the code generator
+        if (left.tag != right.tag) {
+            return false;
+        }
+        bool equal = left.value == right.value;
+        *result = boolean(oprt == EQUAL_EQUAL ? equal : !equal, 0);
+        return true;
+    }
+
+    if (left.tag != NODE_NUMBER || right.tag != NODE_NUMBER) {
+        return false;
+    }
+
+    uint64_t a = left.value;
+    uint64_t b = right.value;
+    switch (oprt) {
+    case PLUS:
+        *result = number(a + b, 0);
+        return true;
+    case MINUS:
+        *result = number(a - b, 0);
+        return true;
+    case STAR:
+        *result = number(a * b, 0);
+        return true;
+    case SLASH:
+        // Division by zero and overflow are left to happen at run time
+        if (right.value == 0 ||
+            (left.value == std::numeric_limits<int64_t>::min() &&
+             right.value == -1)) {
+            return false;
+        }
+        *result = number(left.value / right.value, 0);
+        return true;
+    case LESS:
+        *result = boolean(left.value < right.value, 0);
+        return true;
+    case LESS_EQUAL:
+        *result = boolean(left.value <= right.value, 0);
+        return true;
+    case GREATER:
+        *result = boolean(left.value > right.value, 0);
+        return true;
+    case GREATER_EQUAL:
+        *result = boolean(left.value >= right.value, 0);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Algebraic identities where one side is a number literal. The other side
+// only matters for its value, expressions have no side effects other than
+// failing, so x * 0 is only dropped when x cannot fail.
+bool ConstantFolder::simplify(TokenType oprt, const Folded &left,
+                              const Folded &right, Folded *result) {
+    // Only rewrite when the other side is not a literal of another kind
+    bool left_numeric = !left.constant || left.tag == NODE_NUMBER;
+    bool right_numeric = !right.constant || right.tag == NODE_NUMBER;
+
+    switch (oprt) {
+    case STAR:
+        if ((is_number(left, 0) && right_numeric && !right.may_trap) ||
+            (is_number(right, 0) && left_numeric && !left.may_trap)) {
+            *result = number(0, 0);
+            return true;
+        }
+        if (is_number(right, 1) && left_numeric) {
+            *result = left;
+            return true;
+        }
+        if (is_number(left, 1) && right_numeric) {
+            *result = right;
+            return true;
+        }
+        return false;
+    case PLUS:
+        if (is_number(right, 0) && left_numeric) {
+            *result = left;
+            return true;
+        }
+        if (is_number(left, 0) && right_numeric) {
+            *result = right;
+            return true;
+        }
+        return false;
+    case MINUS:
+        if (is_number(right, 0) && left_numeric) {
+            *result = left;
+            return true;
+        }
+        return false;
+    case SLASH:
+        if (is_number(right, 1) && left_numeric) {
+            *result = left;
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
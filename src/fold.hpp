@@ -0,0 +1,43 @@
+#pragma once
+#include "visitor.hpp"
+
+struct FoldStats {
+    uint32_t nodes_before = 0;
+    uint32_t nodes_after = 0;
+
+    uint32_t removed() const { return nodes_before - nodes_after; }
+};
+
+// Result of folding a subtree: either a literal value that has not been
+// written to the output yet, or the index of the rewritten subtree
+struct Folded {
+    bool constant;
+    NodeTag tag;    // NUMBER, STRING, BOOLEAN or NIL when constant
+    int64_t value;  // number, 0/1 for booleans, intern id for strings
+    NodeIndex node; // output node when not constant
+    uint32_t main_token;
+    bool may_trap = false; // divides by something not known to be nonzero
+};
+
+// AST to AST pass run between the parser and the code generator. Builds a
+// new node table in which literal arithmetic, comparisons, '!' and unary
+// minus are evaluated, groupings are dropped and x * 1, x + 0, x * 0 and
+// friends are simplified. x * 0 keeps an x that may fail at run time.
+class ConstantFolder : public Visitor<ConstantFolder, Folded> {
+  public:
+    Ast fold(const Ast &ast, FoldStats *stats = nullptr);
+
+    Folded visit_binary_expr(NodeIndex index);
+    Folded visit_grouping_expr(NodeIndex index);
+    Folded visit_literal_expr(NodeIndex index);
+    Folded visit_unary_expr(NodeIndex index);
+
+  private:
+    Ast out;
+
+    NodeIndex materialize(const Folded &folded);
+    bool fold_constants(TokenType oprt, const Folded &left,
+                        const Folded &right, Folded *result);
+    bool simplify(TokenType oprt, const Folded &left, const Folded &right,
+                  Folded *result);
+};
@@ -0,0 +1,20 @@
+#include "profile.hpp"
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new so that --time-phases and --trace can
+// count heap allocations. Linked into run.out only, libko.a and the
+// benchmarks leave a host program's operator new alone.
+
+// Every operator new and new[] form without an alignment ends up here
+void *operator new(size_t size) {
+    count_allocation(size);
+    if (void *p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+void operator delete(void *p, size_t) noexcept { free(p); }
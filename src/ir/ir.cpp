@@ -0,0 +1,134 @@
+#include "ir.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+Value IrFunction::add(BasicBlock &block, IrOp op, IrType type, Value lhs,
+                      Value rhs, int64_t imm) {
+    Value value = values.size();
+    values.push_back({op, type, lhs, rhs, imm});
+    block.code.push_back(value);
+    return value;
+}
+
+const char *ir_op_text(IrOp op) {
+    static const char *names[] = {"const", "copy", "add", "sub", "mul",
+                                  "div",   "neg",  "not", "eq",  "ne",
+                                  "lt",    "le",   "gt",  "ge",  "ret"};
+    return names[op];
+}
+
+const char *ir_type_text(IrType type) {
+    static const char *names[] = {"void", "i64", "bool"};
+    return names[type];
+}
+
+IrFunction IrBuilder::build(const Ast &ast) {
+    this->ast = &ast;
+    label_nodes();
+
+    function = IrFunction();
+    function.blocks.emplace_back();
+    Value result = visit(ast.root);
+    add(IR_RET, IR_VOID, result);
+    return std::move(function);
+}
+
+Value IrBuilder::add(IrOp op, IrType type, Value lhs, Value rhs, int64_t imm) {
+    return function.add(function.blocks.back(), op, type, lhs, rhs, imm);
+}
+
+// Literals become immediates in the backends and cost no register while
+// the other operand is computed. Children are always added to the node
+// table before their parent.
+void IrBuilder::label_nodes() {
+    need.assign(ast->nodes.size(), 0);
+    for (NodeIndex i = 0; i < ast->nodes.size(); i++) {
+        const Node &node = ast->at(i);
+        switch (node.tag) {
+        case NODE_BINARY: {
+            uint32_t left = need[node.lhs];
+            uint32_t right = need[node.rhs];
+            need[i] = std::max(left == right ? left + 1 : std::max(left, right),
+                               1u);
+            break;
+        }
+        case NODE_GROUPING:
+            need[i] = need[node.lhs];
+            break;
+        case NODE_UNARY:
+            need[i] = std::max(need[node.lhs], 1u);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+Value IrBuilder::visit_binary_expr(NodeIndex index) {
+    const Node &node = ast->at(index);
+
+    Value left, right;
+    if (need[node.rhs] > need[node.lhs]) {
+        right = visit(node.rhs);
+        left = visit(node.lhs);
+    } else {
+        left = visit(node.lhs);
+        right = visit(node.rhs);
+    }
+
+    switch (node.oprt) {
+    case PLUS:
+        return add(IR_ADD, IR_I64, left, right);
+    case MINUS:
+        return add(IR_SUB, IR_I64, left, right);
+    case STAR:
+        return add(IR_MUL, IR_I64, left, right);
+    case SLASH:
+        return add(IR_DIV, IR_I64, left, right);
+    case EQUAL_EQUAL:
+        return add(IR_EQ, IR_BOOL, left, right);
+    case BANG_EQUAL:
+        return add(IR_NE, IR_BOOL, left, right);
+    case LESS:
+        return add(IR_LT, IR_BOOL, left, right);
+    case LESS_EQUAL:
+        return add(IR_LE, IR_BOOL, left, right);
+    case GREATER:
+        return add(IR_GT, IR_BOOL, left, right);
+    case GREATER_EQUAL:
+        return add(IR_GE, IR_BOOL, left, right);
+    default:
+        throw std::runtime_error("Code generation: unsupported operator " +
+                                 std::string(token_type_text(node.oprt)));
+    }
+}
+
+Value IrBuilder::visit_grouping_expr(NodeIndex index) {
+    return visit(ast->at(index).lhs);
+}
+
+Value IrBuilder::visit_literal_expr(NodeIndex index) {
+    const Node &node = ast->at(index);
+    switch (node.tag) {
+    case NODE_NUMBER:
+        return add(IR_CONST, IR_I64, NO_VALUE, NO_VALUE, ast->number(index));
+    case NODE_STRING:
+        throw std::runtime_error(
+            "Code generation: string literals are not supported");
+    case NODE_BOOLEAN:
+        return add(IR_CONST, IR_BOOL, NO_VALUE, NO_VALUE, node.lhs);
+    default:
+        return add(IR_CONST, IR_I64, NO_VALUE, NO_VALUE, 0);
+    }
+}
+
+Value IrBuilder::visit_unary_expr(NodeIndex index) {
+    const Node &node = ast->at(index);
+    Value operand = visit(node.lhs);
+
+    if (node.oprt == BANG) {
+        // false, nil and 0 are falsy
+        return add(IR_NOT, IR_BOOL, operand);
+    }
+    return add(IR_NEG, IR_I64, operand);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "../visitor.hpp"
+#include <cstdint>
+#include <vector>
+
+// SSA value: the index of the single instruction that defines it
+typedef uint32_t Value;
+
+const Value NO_VALUE = UINT32_MAX;
+
+enum IrType : uint8_t {
+    IR_VOID,
+    IR_I64,  // numbers, and nil as 0
+    IR_BOOL, // 0 or 1
+};
+
+enum IrOp : uint8_t {
+    IR_CONST, // imm
+    IR_COPY,  // lhs
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_NEG,
+    IR_NOT,
+    IR_EQ,
+    IR_NE,
+    IR_LT,
+    IR_LE,
+    IR_GT,
+    IR_GE,
+    IR_RET, // lhs, ends the block
+};
+
+struct IrInstr {
+    IrOp op;
+    IrType type;
+    Value lhs;
+    Value rhs;
+    int64_t imm;
+};
+
+struct BasicBlock {
+    std::vector<Value> code; // instructions in execution order
+};
+
+// Three-address code in SSA form. Every instruction defines one value and
+// operands refer to values by index, so rewriting an operand never needs
+// to look at anything but the instruction itself.
+struct IrFunction {
+    std::vector<IrInstr> values;
+    std::vector<BasicBlock> blocks;
+
+    const IrInstr &at(Value value) const { return values[value]; }
+    Value add(BasicBlock &block, IrOp op, IrType type, Value lhs = NO_VALUE,
+              Value rhs = NO_VALUE, int64_t imm = 0);
+};
+
+const char *ir_op_text(IrOp op);
+const char *ir_type_text(IrType type);
+
+// Lowers the AST of one program into a single-block function ending in a
+// ret of the program's value. Operands are emitted in Sethi-Ullman order,
+// the subtree that needs more registers first.
+class IrBuilder : public Visitor<IrBuilder, Value> {
+  public:
+    IrFunction build(const Ast &ast);
+
+    Value visit_binary_expr(NodeIndex index);
+    Value visit_grouping_expr(NodeIndex index);
+    Value visit_literal_expr(NodeIndex index);
+    Value visit_unary_expr(NodeIndex index);
+
+  private:
+    IrFunction function;
+    std::vector<uint32_t> need; // registers each subtree needs
+
+    void label_nodes();
+    Value add(IrOp op, IrType type, Value lhs = NO_VALUE, Value rhs = NO_VALUE,
+              int64_t imm = 0);
+};
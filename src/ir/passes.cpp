@@ -0,0 +1,161 @@
+#include "passes.hpp"
+#include "util.hpp"
+#include <iostream>
+#include <unordered_map>
+
+void PassManager::add(const char *name, IrPass pass) {
+    passes.push_back({name, pass});
+}
+
+void PassManager::run(IrFunction &function) const {
+    for (const Entry &entry : passes) {
+        if (entry.pass(function)) {
+            debug_print("Pass " << entry.name << " changed the function");
+        }
+    }
+}
+
+PassManager PassManager::standard() {
+    PassManager manager;
+    manager.add("cse", common_subexpressions);
+    manager.add("copy-prop", copy_propagation);
+    manager.add("dce", dead_code);
+    return manager;
+}
+
+// Operands of a copy are resolved to the value it copies, following chains
+bool copy_propagation(IrFunction &function) {
+    auto source = [&](Value value) {
+        while (value != NO_VALUE && function.values[value].op == IR_COPY) {
+            value = function.values[value].lhs;
+        }
+        return value;
+    };
+
+    bool changed = false;
+    for (IrInstr &instr : function.values) {
+        if (instr.op == IR_COPY) {
+            continue;
+        }
+        Value lhs = source(instr.lhs);
+        Value rhs = source(instr.rhs);
+        changed |= lhs != instr.lhs || rhs != instr.rhs;
+        instr.lhs = lhs;
+        instr.rhs = rhs;
+    }
+    return changed;
+}
+
+namespace {
+struct ExpressionKey {
+    IrOp op;
+    IrType type;
+    Value lhs;
+    Value rhs;
+    int64_t imm;
+
+    bool operator==(const ExpressionKey &other) const {
+        return op == other.op && type == other.type && lhs == other.lhs &&
+               rhs == other.rhs && imm == other.imm;
+    }
+};
+
+struct ExpressionHash {
+    size_t operator()(const ExpressionKey &key) const {
+        size_t hash = key.op * 31 + key.type;
+        hash = hash * 1000003 ^ key.lhs;
+        hash = hash * 1000003 ^ key.rhs;
+        return hash * 1000003 ^ std::hash<int64_t>()(key.imm);
+    }
+};
+} // namespace
+
+static bool commutative(IrOp op) {
+    return op == IR_ADD || op == IR_MUL || op == IR_EQ || op == IR_NE;
+}
+
+// Local value numbering. A repeated expression becomes a copy of its first
+// occurrence; copy propagation and dead code elimination remove it. Values
+// never cross blocks yet, so every block starts with an empty table.
+bool common_subexpressions(IrFunction &function) {
+    bool changed = false;
+    std::unordered_map<ExpressionKey, Value, ExpressionHash> seen;
+
+    // Operands are compared by the first value computing the same thing,
+    // so expressions over earlier duplicates match as well
+    std::vector<Value> number(function.values.size());
+    for (Value value = 0; value < number.size(); value++) {
+        number[value] = value;
+    }
+    auto numbered = [&](Value value) {
+        return value == NO_VALUE ? value : number[value];
+    };
+
+    for (BasicBlock &block : function.blocks) {
+        seen.clear();
+        for (Value value : block.code) {
+            IrInstr &instr = function.values[value];
+            if (instr.op == IR_COPY) {
+                number[value] = numbered(instr.lhs);
+                continue;
+            }
+            if (instr.op == IR_RET) {
+                continue;
+            }
+
+            ExpressionKey key = {instr.op, instr.type, numbered(instr.lhs),
+                                 numbered(instr.rhs), instr.imm};
+            if (commutative(instr.op) && key.rhs < key.lhs) {
+                std::swap(key.lhs, key.rhs);
+            }
+
+            auto found = seen.emplace(key, value);
+            if (!found.second) {
+                number[value] = found.first->second;
+                instr = {IR_COPY, instr.type, found.first->second, NO_VALUE,
+                         0};
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+// Instructions have no side effects, so anything the ret does not reach
+// is dropped from its block
+bool dead_code(IrFunction &function) {
+    std::vector<bool> live(function.values.size(), false);
+
+    // Operands are defined before their users, so one backwards sweep over
+    // each block sees every user before the values it reads
+    for (BasicBlock &block : function.blocks) {
+        for (auto it = block.code.rbegin(); it != block.code.rend(); ++it) {
+            const IrInstr &instr = function.values[*it];
+            if (instr.op == IR_RET) {
+                live[*it] = true;
+            }
+            if (!live[*it]) {
+                continue;
+            }
+            if (instr.lhs != NO_VALUE) {
+                live[instr.lhs] = true;
+            }
+            if (instr.rhs != NO_VALUE) {
+                live[instr.rhs] = true;
+            }
+        }
+    }
+
+    bool changed = false;
+    for (BasicBlock &block : function.blocks) {
+        size_t kept = 0;
+        for (Value value : block.code) {
+            if (live[value]) {
+                block.code[kept++] = value;
+            }
+        }
+        changed |= kept != block.code.size();
+        block.code.resize(kept);
+    }
+    return changed;
+}
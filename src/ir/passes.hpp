@@ -0,0 +1,27 @@
+#pragma once
+#include "ir.hpp"
+#include <string>
+#include <vector>
+
+// A pass rewrites the function in place and returns whether it changed it
+typedef bool (*IrPass)(IrFunction &function);
+
+bool copy_propagation(IrFunction &function);
+bool common_subexpressions(IrFunction &function);
+bool dead_code(IrFunction &function);
+
+// Runs passes in the order they were added
+class PassManager {
+    struct Entry {
+        const char *name;
+        IrPass pass;
+    };
+    std::vector<Entry> passes;
+
+  public:
+    void add(const char *name, IrPass pass);
+    void run(IrFunction &function) const;
+
+    // cse, copy-prop and dce, in that order
+    static PassManager standard();
+};
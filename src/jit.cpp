@@ -0,0 +1,39 @@
+#include "jit.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+typedef int64_t (*JitFunction)();
+
+int64_t run_jit(const std::vector<uint8_t> &code) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (code.size() + page - 1) / page * page;
+    if (size == 0) {
+        throw std::runtime_error("JIT: no code to run");
+    }
+
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error(std::string("JIT: mmap failed: ") +
+                                 strerror(errno));
+    }
+    memcpy(memory, code.data(), code.size());
+
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) < 0) {
+        int error = errno;
+        munmap(memory, size);
+        throw std::runtime_error(std::string("JIT: mprotect failed: ") +
+                                 strerror(error));
+    }
+    // Instruction caches are not coherent with data writes on ARM
+    __builtin___clear_cache(static_cast<char *>(memory),
+                            static_cast<char *>(memory) + code.size());
+
+    int64_t result = reinterpret_cast<JitFunction>(memory)();
+    munmap(memory, size);
+    return result;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Runs machine code from Backend::encode_function() in-process and returns
+// its result. The code is copied into a fresh mapping that is writable
+// while it is filled and only executable once it is sealed, never both.
+int64_t run_jit(const std::vector<uint8_t> &code);
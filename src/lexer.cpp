@@ -1,6 +1,6 @@
 #include "lexer.hpp"
+#include "scan.hpp"
 #include <iostream>
-#include <unordered_map>
 
 // clang-format off
 #define DIGIT                                                                  \
@@ -19,282 +19,369 @@
         : case 'X' : case 'Y' : case 'Z'
 // clang-format on
 
-/* struct Keyword { */
-/*     std::string text; */
-/*     TokenType type; */
-/* }; */
+/*
+ * Keyword recognition
+ *
+ * Every keyword of the TokenType enum is placed in a 128 slot table by a
+ * perfect hash whose seed is searched for at compile time. Classifying an
+ * identifier is one hash, one probe and one compare.
+ */
 
-// TODO: Extend
-static std::unordered_map<std::string, TokenType> keywords = {
-    {"auto", AUTO},   {"true", TRUE},     {"false", FALSE}, {"break", BREAK},
-    {"char", CHAR},   {"const", CONST},   {"do", DO},       {"double", DOUBLE},
-    {"else", ELSE},   {"float", FLOAT},   {"for", FOR},     {"if", IF},
-    {"int", INT},     {"long", LONG},     {"NULL", _NULL},  {"return", RETURN},
-    {"short", SHORT}, {"struct", STRUCT}, {"void", VOID},   {"while", WHILE}};
+struct Keyword {
+    std::string_view text;
+    TokenType type;
+};
 
-// Add a token to tokens vector. Text is determined by start/current indices
-void add_token(Lexer *l, const TokenType type) {
-    std::string text;
-    for (unsigned long i = l->start; i < l->current + 1; i++) {
-        text += l->input.at(i);
-    }
+// clang-format off
+constexpr Keyword keyword_list[] = {
+    {"auto", AUTO},         {"break", BREAK},       {"char", CHAR},
+    {"const", CONST},       {"continue", CONTINUE}, {"default", DEFAULT},
+    {"do", DO},             {"double", DOUBLE},     {"else", ELSE},
+    {"enum", ENUM},         {"extern", EXTERN},     {"false", FALSE},
+    {"float", FLOAT},       {"for", FOR},           {"goto", GOTO},
+    {"if", IF},             {"int", INT},           {"long", LONG},
+    {"NULL", _NULL},        {"register", REGISTER}, {"return", RETURN},
+    {"short", SHORT},       {"signed", SIGNED},     {"sizeof", SIZEOF},
+    {"static", STATIC},     {"struct", STRUCT},     {"switch", SWITCH},
+    {"true", TRUE},         {"typedef", TYPEDEF},   {"union", UNION},
+    {"unsigned", UNSIGNED}, {"void", VOID},         {"volatile", VOLATILE},
+    {"while", WHILE}};
+// clang-format on
 
-    Token token = {};
-    token.type = type;
-    token.text = text;
-    token.start_pos = l->start;
-    token.line = l->line;
-    l->tokens.push_back(token);
-}
+constexpr size_t KEYWORD_COUNT = sizeof(keyword_list) / sizeof(Keyword);
+constexpr uint32_t KEYWORD_SLOTS = 128; // must be a power of two
 
-// Finalize token information before advancing
-// TODO: Delete if end_pos is unused
-void consume(Lexer *l) {
-    Token token = l->tokens.back();
-    token.end_pos = l->current;
+constexpr size_t longest_keyword() {
+    size_t longest = 0;
+    for (size_t i = 0; i < KEYWORD_COUNT; i++) {
+        if (keyword_list[i].text.size() > longest) {
+            longest = keyword_list[i].text.size();
+        }
+    }
+    return longest;
 }
 
-void advance(Lexer *l) {
-    l->current++;
-    l->column++;
-}
+constexpr size_t KEYWORD_MAX_LENGTH = longest_keyword();
 
-char peek(const Lexer l, const unsigned long offset) {
-    if (l.current + offset > l.input.size()) {
-        return 0;
+// FNV-1a with the seed folded into the offset basis
+constexpr uint32_t keyword_hash(std::string_view text, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < text.size(); i++) {
+        h = (h ^ static_cast<unsigned char>(text[i])) * 16777619u;
     }
-    return l.input.at(l.current + offset);
+    return (h ^ (h >> 16)) & (KEYWORD_SLOTS - 1);
 }
 
-void lex_string(Lexer *l) {
-    while (peek(*l) && peek(*l) != '"') {
-        if (peek(*l) == '\n') {
-            l->line++;
+constexpr bool is_perfect_seed(uint32_t seed) {
+    bool used[KEYWORD_SLOTS] = {};
+    for (size_t i = 0; i < KEYWORD_COUNT; i++) {
+        uint32_t slot = keyword_hash(keyword_list[i].text, seed);
+        if (used[slot]) {
+            return false;
         }
-        advance(l);
+        used[slot] = true;
     }
+    return true;
+}
 
-    if (l->current > l->input.size()) {
-        lexer_error(l->line, l->column);
-        return;
+constexpr uint32_t find_keyword_seed() {
+    uint32_t seed = 0;
+    while (!is_perfect_seed(seed)) {
+        seed++;
     }
+    return seed;
+}
 
-    advance(l);
-    // custom add_token()
-    std::string text;
-    for (unsigned long i = l->start + 1; i < l->current; i++) {
-        text += l->input.at(i);
-    }
+constexpr uint32_t KEYWORD_SEED = find_keyword_seed();
 
-    Token token = {};
-    token.type = STRING;
-    token.text = text;
-    token.start_pos = l->start;
-    token.line = l->line;
-    l->tokens.push_back(token);
+struct KeywordTable {
+    // Index into keyword_list plus one, 0 marks an empty slot
+    uint8_t slots[KEYWORD_SLOTS];
+};
 
-    consume(l);
+constexpr KeywordTable build_keyword_table() {
+    KeywordTable table = {};
+    for (size_t i = 0; i < KEYWORD_COUNT; i++) {
+        table.slots[keyword_hash(keyword_list[i].text, KEYWORD_SEED)] = i + 1;
+    }
+    return table;
 }
 
-bool is_digit(const char c) {
-    switch (c) {
-    case DIGIT:
-        return true;
-    default:
-        return false;
+constexpr KeywordTable keyword_table = build_keyword_table();
+
+constexpr TokenType keyword_type(std::string_view text) {
+    if (text.size() > KEYWORD_MAX_LENGTH) {
+        return IDENTIFIER;
     }
-}
 
-void lex_number(Lexer *l) {
-    while (peek(*l) && is_digit(peek(*l))) {
-        advance(l);
+    uint8_t slot = keyword_table.slots[keyword_hash(text, KEYWORD_SEED)];
+    if (slot && keyword_list[slot - 1].text == text) {
+        return keyword_list[slot - 1].type;
     }
+    return IDENTIFIER;
+}
 
-    if (peek(*l) == '.' && is_digit(peek(*l, 2))) {
-        advance(l);
-        while (peek(*l) && is_digit(peek(*l))) {
-            advance(l);
+constexpr bool all_keywords_found() {
+    for (size_t i = 0; i < KEYWORD_COUNT; i++) {
+        if (keyword_type(keyword_list[i].text) != keyword_list[i].type) {
+            return false;
         }
     }
+    return true;
+}
 
-    add_token(l, NUMBER);
-    consume(l);
+static_assert(all_keywords_found(), "keyword table is not a perfect hash");
+static_assert(keyword_type("main") == IDENTIFIER, "identifier as keyword");
+
+// Hand out a token from next_token(). The text is a view into the input
+void set_token(Lexer *l, const TokenType type, uint64_t offset,
+               uint32_t length, uint32_t id) {
+    l->token.type = type;
+    l->token.id = id;
+    l->token.text = l->input.substr(offset, length);
+    l->has_token = true;
 }
 
-bool is_alphanumeric(const char c) {
-    switch (c) {
-    case ALPHA:
-    case DIGIT:
-        return true;
-    default:
-        return false;
+// Hand out a token whose text is determined by start/current indices
+void add_token(Lexer *l, const TokenType type) {
+    set_token(l, type, l->start, l->current + 1 - l->start, 0);
+}
+
+void advance(Lexer *l) { l->current++; }
+
+// Move current onto the last character of the run that follows it, using
+// one of the scanning kernels to find where the run ends
+void skip_run(Lexer *l, const char *(*kernel)(const char *, const char *)) {
+    const char *begin = l->input.data();
+    const char *end = begin + l->input.size();
+    l->current = kernel(begin + l->current + 1, end) - begin - 1;
+}
+
+char peek(const Lexer &l, const uint64_t offset) {
+    if (l.current + offset >= l.input.size()) {
+        return 0;
     }
+    return l.input[l.current + offset];
 }
 
-bool is_keyword(std::string text) {
-    if (keywords[text]) {
-        return true;
+void lex_string(Lexer *l) {
+    skip_run(l, l->scan->find_quote);
+
+    if (l->current > l->input.size()) {
+        report_error(l);
+        return;
     }
 
-    return false;
+    advance(l);
+    // custom add_token(), the quotes are not part of the text
+    uint64_t offset = l->start + 1;
+    uint32_t length = l->current - offset;
+    uint32_t id = l->interner->intern(l->input.substr(offset, length));
+    set_token(l, STRING, offset, length, id);
 }
 
-void lex_alphanumeric(Lexer *l) {
-    while (is_alphanumeric(peek(*l))) {
+bool is_digit(const char c) { return has_class(c, CC_DIGIT); }
+
+void lex_number(Lexer *l) {
+    skip_run(l, l->scan->skip_digits);
+
+    if (peek(*l) == '.' && is_digit(peek(*l, 2))) {
         advance(l);
+        skip_run(l, l->scan->skip_digits);
     }
 
-    std::string text;
-    for (unsigned long i = l->start; i < l->current + 1; i++) {
-        text += l->input.at(i);
-    }
+    add_token(l, NUMBER);
+}
 
-    TokenType type;
-    if (is_keyword(text)) {
-        type = keywords[text];
+bool is_alphanumeric(const char c) { return has_class(c, CC_ALNUM); }
+
+void lex_alphanumeric(Lexer *l) {
+    skip_run(l, l->scan->skip_alnum);
+
+    uint32_t length = l->current + 1 - l->start;
+    std::string_view text = l->input.substr(l->start, length);
+
+    TokenType type = keyword_type(text);
+    if (type == IDENTIFIER) {
+        set_token(l, IDENTIFIER, l->start, length, l->interner->intern(text));
     } else {
-        type = IDENTIFIER;
+        add_token(l, type);
     }
-
-    add_token(l, type);
-    consume(l);
 }
 
-std::vector<Token> lex(const std::vector<char> input,
-                       std::vector<Token> &tokens) {
-    bool encountered_error = false;
-
-    Lexer l = {};
-    l.input = input;
-    l.tokens = tokens;
-    l.line = 1;   // line number
-    l.column = 1; // column number
-    l.start = 0;  // index of first character in token (relative to input)
-    l.current =
+void init_lexer(Lexer *l, std::string_view input, Interner &interner,
+                std::ostream &errors) {
+    *l = {};
+    l->input = input;
+    l->interner = &interner;
+    l->errors = &errors;
+    l->scan = &scan_kernels();
+    l->error_line = 1;
+    l->start = 0;  // index of first character in token (relative to input)
+    l->current =
         0; // index of character currently being looked at (relative to input)
-    while (l.current < input.size()) {
-        l.start = l.current;
-        char token = input.at(l.current);
+}
+
+// Scan forward until one token has been produced. Lexer errors are reported
+// as they are found and raised once the whole input has been consumed.
+bool next_token(Lexer *l) {
+    l->has_token = false;
+    while (!l->has_token && l->current < l->input.size()) {
+        l->start = l->current;
+        char token = l->input[l->current];
 
         switch (token) {
         case '(':
-            add_token(&l, LEFT_PAREN);
-            consume(&l);
+            add_token(l, LEFT_PAREN);
             break;
         case ')':
-            add_token(&l, RIGHT_PAREN);
-            consume(&l);
+            add_token(l, RIGHT_PAREN);
             break;
         case '{':
-            add_token(&l, LEFT_BRACE);
-            consume(&l);
+            add_token(l, LEFT_BRACE);
             break;
         case '}':
-            add_token(&l, RIGHT_BRACE);
-            consume(&l);
+            add_token(l, RIGHT_BRACE);
             break;
         case ',':
-            add_token(&l, COMMA);
-            consume(&l);
+            add_token(l, COMMA);
             break;
         case '.':
-            add_token(&l, DOT);
-            consume(&l);
+            add_token(l, DOT);
             break;
         case '-':
-            add_token(&l, MINUS);
-            consume(&l);
+            add_token(l, MINUS);
             break;
         case '+':
-            add_token(&l, PLUS);
-            consume(&l);
+            add_token(l, PLUS);
             break;
         case ';':
-            add_token(&l, SEMICOLON);
-            consume(&l);
+            add_token(l, SEMICOLON);
             break;
         case '*':
-            add_token(&l, STAR);
-            consume(&l);
+            add_token(l, STAR);
             break;
         case ' ':
         case '\r':
         case '\t':
-            break;
         case '\n':
-            l.line++;
-            l.column = 0;
+            skip_run(l, l->scan->skip_whitespace);
             break;
         case '!':
-            if (peek(l) == '=') {
-                advance(&l);
-                add_token(&l, BANG_EQUAL);
+            if (peek(*l) == '=') {
+                advance(l);
+                add_token(l, BANG_EQUAL);
             } else {
-                add_token(&l, BANG);
-                consume(&l);
+                add_token(l, BANG);
             }
             break;
         case '=':
-            if (peek(l) == '=') {
-                advance(&l);
-                add_token(&l, EQUAL_EQUAL);
+            if (peek(*l) == '=') {
+                advance(l);
+                add_token(l, EQUAL_EQUAL);
             } else {
-                add_token(&l, EQUAL);
-                consume(&l);
+                add_token(l, EQUAL);
             }
             break;
         case '>':
-            if (peek(l) == '=') {
-                advance(&l);
-                add_token(&l, GREATER_EQUAL);
+            if (peek(*l) == '=') {
+                advance(l);
+                add_token(l, GREATER_EQUAL);
             } else {
-                add_token(&l, GREATER);
-                consume(&l);
+                add_token(l, GREATER);
             }
             break;
         case '<':
-            if (peek(l) == '=') {
-                advance(&l);
-                add_token(&l, LESS_EQUAL);
+            if (peek(*l) == '=') {
+                advance(l);
+                add_token(l, LESS_EQUAL);
             } else {
-                add_token(&l, LESS);
-                consume(&l);
+                add_token(l, LESS);
             }
             break;
         case '/':
-            if (peek(l) == '/') {
-                while (peek(l) && peek(l) != '\n') {
-                    advance(&l);
-                }
+            if (peek(*l) == '/') {
+                skip_run(l, l->scan->find_newline);
             } else {
-                add_token(&l, SLASH);
-                consume(&l);
+                add_token(l, SLASH);
             }
             break;
         case '"':
-            lex_string(&l);
+            lex_string(l);
             break;
         case DIGIT:
-            lex_number(&l);
+            lex_number(l);
             break;
         case ALPHA:
-            lex_alphanumeric(&l);
+            lex_alphanumeric(l);
             break;
         default:
-            encountered_error = true;
-            lexer_error(l.line, l.column);
+            l->encountered_error = true;
+            report_error(l);
         }
-        advance(&l);
+        advance(l);
     }
 
-    if (encountered_error) {
+    if (!l->has_token && l->encountered_error) {
         throw std::runtime_error(
             "Lexer error encountered. Terminating compilation");
     }
-    return l.tokens;
+    return l->has_token;
+}
+
+TokenStream lex(std::string_view input, Interner &interner) {
+    return lex(input, interner, std::cout);
+}
+
+TokenStream lex(std::string_view input, Interner &interner,
+                std::ostream &errors, std::vector<LexerError> *error_list,
+                bool *failed) {
+    Lexer l;
+    init_lexer(&l, input, interner, errors);
+    l.error_list = error_list;
+
+    TokenStream tokens;
+    tokens.source = input;
+    tokens.interner = &interner;
+    try {
+        while (next_token(&l)) {
+            tokens.push(l.token.type, l.token.text.data() - input.data(),
+                        l.token.text.size(), l.token.id);
+        }
+    } catch (std::runtime_error &) {
+        if (!failed) {
+            throw;
+        }
+    }
+    if (failed) {
+        *failed = l.encountered_error;
+    }
+
+    return tokens;
+}
+
+// Positions are only needed for diagnostics, so they are worked out here
+// instead of being tracked for every character
+void report_error(Lexer *l) {
+    for (uint64_t i = l->error_offset; i < l->current; i++) {
+        if (l->input[i] == '\n') {
+            l->error_line++;
+            l->error_line_start = i + 1;
+        }
+    }
+    l->error_offset = l->current;
+    int column = l->current - l->error_line_start + 1;
+    lexer_error(*l->errors, l->error_line, column);
+    if (l->error_list) {
+        l->error_list->push_back({l->error_line, column});
+    }
+}
+
+void lexer_error(std::ostream &errors, int line, int column) {
+    errors << lexer_error_text(line, column) << std::endl;
 }
 
-void lexer_error(int line, int column) {
-    std::cout << "Error: unexpected token at " << line << ":" << column
-              << std::endl;
+std::string lexer_error_text(int line, int column) {
+    return "Error: unexpected token at " + std::to_string(line) + ":" +
+           std::to_string(column);
 }
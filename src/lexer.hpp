@@ -1,91 +1,63 @@
 #pragma once
 
-#include <vector>
+#include "token_stream.hpp"
+#include <iosfwd>
 #include <string>
+#include <string_view>
+#include <vector>
 
-enum TokenType {
-    LEFT_PAREN,
-    RIGHT_PAREN,
-    LEFT_BRACE,
-    RIGHT_BRACE,
-    COMMA,
-    DOT,
-    MINUS,
-    PLUS,
-    SEMICOLON,
-    STAR,
-    SLASH,
-    BANG,
-    EQUAL,
-    BANG_EQUAL,
-    EQUAL_EQUAL,
-    GREATER,
-    GREATER_EQUAL,
-    LESS,
-    LESS_EQUAL,
-    STRING,
-    NUMBER,
-    IDENTIFIER,
-    TRUE,
-    FALSE,
-    AUTO,
-    BREAK,
-    CHAR,
-    CONST,
-    CONTINUE,
-    DEFAULT,
-    DO,
-    DOUBLE,
-    ELSE,
-    ENUM,
-    EXTERN,
-    FLOAT,
-    FOR,
-    GOTO,
-    IF,
-    INT,
-    LONG,
-    _NULL,
-    REGISTER,
-    RETURN,
-    SHORT,
-    SIGNED,
-    SIZEOF,
-    STATIC,
-    STRUCT,
-    SWITCH,
-    TYPEDEF,
-    UNION,
-    UNSIGNED,
-    VOID,
-    VOLATILE,
-    WHILE,
-};
+struct ScanKernels;
 
-struct Token {
-    TokenType type;
-    std::string text;
-    int start_pos;
-    int end_pos;
+// Position of an unexpected character, 1-based
+struct LexerError {
     int line;
+    int column;
 };
 
 struct Lexer {
-    int line;
-    unsigned long current;
-    int start;
-    int column;
-    Token* current_token;
-    std::vector<char> input;
-    std::vector<Token> tokens;
+    uint64_t current;
+    uint64_t start;
+    std::string_view input;
+    const ScanKernels *scan;
+    Interner *interner;
+    std::ostream *errors; // where lexer errors are reported
+    std::vector<LexerError> *error_list; // also collects them when set
+    Token token; // last token produced by next_token()
+    bool has_token;
+    bool encountered_error;
+    // Location of the last reported error, later errors resume from here
+    uint64_t error_offset;
+    int error_line;
+    uint64_t error_line_start;
 };
 
+void set_token(Lexer *l, const TokenType type, uint64_t offset,
+               uint32_t length, uint32_t id);
 void add_token(Lexer* l, const TokenType type);
-void consume(Lexer* l);
 void advance(Lexer *l);
-char peek(const Lexer l, const unsigned long offset = 1);
+void skip_run(Lexer *l, const char *(*kernel)(const char *, const char *));
+char peek(const Lexer &l, const uint64_t offset = 1);
 void lex_string(Lexer *l);
 bool is_digit(const char c);
 void lex_number(Lexer *l);
-std::vector<Token> lex(std::vector<char> input, std::vector<Token> &lexemes);
-void lexer_error(int line, int column);
+void lex_alphanumeric(Lexer *l);
+void init_lexer(Lexer *l, std::string_view input, Interner &interner,
+                std::ostream &errors);
+bool next_token(Lexer *l);
+TokenStream lex(std::string_view input, Interner &interner);
+// Lexer errors raise once the whole input is lexed. With failed set they
+// are flagged there instead and the tokens around them are returned.
+TokenStream lex(std::string_view input, Interner &interner,
+                std::ostream &errors,
+                std::vector<LexerError> *error_list = nullptr,
+                bool *failed = nullptr);
+// The tokens, ids and errors lex() produces, with the input split at line
+// starts into up to chunks pieces that are lexed on threads of their own
+TokenStream lex_parallel(std::string_view input, Interner &interner,
+                         std::ostream &errors, unsigned chunks,
+                         std::vector<LexerError> *error_list = nullptr,
+                         bool *failed = nullptr);
+void report_error(Lexer *l);
+void lexer_error(std::ostream &errors, int line, int column);
+// The line lexer_error() prints, without the newline
+std::string lexer_error_text(int line, int column);
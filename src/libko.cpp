@@ -0,0 +1,305 @@
+#include "libko.hpp"
+#include "asm_writer.hpp"
+#include "backend.hpp"
+#include "ir/passes.hpp"
+#include "jit.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "printers/ast_printer.hpp"
+#include "printers/bytecode_printer.hpp"
+#include "printers/ir_printer.hpp"
+#include "profile.hpp"
+#include "util.hpp"
+#include "vm/vm.hpp"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+namespace ko {
+
+static void fail(Result &result, const char *phase, const std::exception &e) {
+    result.diagnostics.push_back({phase, e.what()});
+    result.status = EXIT_FAILURE;
+}
+
+// 1-based line and column of a byte offset
+static void locate(std::string_view source, uint64_t offset,
+                   Diagnostic &diagnostic) {
+    diagnostic.line = 1;
+    uint64_t line_start = 0;
+    for (uint64_t i = 0; i < offset && i < source.size(); i++) {
+        if (source[i] == '\n') {
+            diagnostic.line++;
+            line_start = i + 1;
+        }
+    }
+    diagnostic.column = offset - line_start + 1;
+}
+
+static void report_lexer_errors(std::vector<LexerError>::const_iterator first,
+                                std::vector<LexerError>::const_iterator last,
+                                Result &result) {
+    for (; first != last; ++first) {
+        result.diagnostics.push_back(
+            {"lex", lexer_error_text(first->line, first->column),
+             first->line, first->column});
+    }
+}
+
+static void lexing_failed(const std::vector<LexerError> &errors,
+                          Result &result) {
+    report_lexer_errors(errors.begin(), errors.end(), result);
+    result.status = EXIT_FAILURE;
+}
+
+// The lexer errors before the parse error come first and those after it
+// follow, however the source was lexed
+static void parsing_failed(std::string_view source, const Parser &parser,
+                           const std::exception &e,
+                           const std::vector<LexerError> &lexer_errors,
+                           Result &result) {
+    Diagnostic error = {"parse", e.what()};
+    uint64_t offset = parser.error_text.data()
+                          ? parser.error_text.data() - source.data()
+                          : source.size();
+    locate(source, offset, error);
+    auto after = std::find_if(
+        lexer_errors.begin(), lexer_errors.end(), [&](LexerError lexed) {
+            return lexed.line > error.line ||
+                   (lexed.line == error.line && lexed.column > error.column);
+        });
+    report_lexer_errors(lexer_errors.begin(), after, result);
+    result.diagnostics.push_back(error);
+    report_lexer_errors(after, lexer_errors.end(), result);
+    result.status = EXIT_FAILURE;
+}
+
+// Lexes and parses source into ast, its strings into interner. Returns
+// false when either failed.
+static bool parse(std::string_view source, const Options &options,
+                  PhaseTimer &timer, Interner &interner, Ast &ast,
+                  Result &result) {
+    std::vector<LexerError> lexer_errors;
+    // The same errors as text, only the list is kept
+    std::ostringstream errors;
+    Parser parser;
+    unsigned chunks = std::max(options.lex_threads, 1u);
+    if (timer.enabled() || chunks > 1) {
+        debug_print("Lex tokens");
+        TokenStream stream;
+        bool lex_failed = false;
+        try {
+            timer.begin("lex");
+            stream = lex_parallel(source, interner, errors, chunks,
+                                  &lexer_errors, &lex_failed);
+            PhaseStats &lexed = timer.end();
+            lexed.bytes = source.size();
+            lexed.tokens = stream.size();
+        } catch (std::exception &e) {
+            fail(result, "lex", e);
+            return false;
+        }
+
+        // The tokens around lexer errors are parsed too, so a parse error
+        // before them is reported as the streaming lexer below would
+        debug_print("Parse tokens");
+        try {
+            timer.begin("parse");
+            StreamSource tokens(stream);
+            parser.parse(tokens, ast);
+            if (lex_failed) {
+                lexing_failed(lexer_errors, result);
+                return false;
+            }
+            PhaseStats &parsed = timer.end();
+            parsed.tokens = stream.size();
+            parsed.nodes = ast.nodes.size();
+            return true;
+        } catch (std::exception &e) {
+            parsing_failed(source, parser, e, lexer_errors, result);
+        }
+    } else {
+        debug_print("Lex and parse tokens");
+        LexerSource tokens(source, interner, errors, &lexer_errors);
+        try {
+            parser.parse(tokens, ast);
+            return true;
+        } catch (std::exception &e) {
+            if (tokens.failed()) {
+                lexing_failed(lexer_errors, result);
+                return false;
+            }
+            // The rest of the input is lexed for its errors, which the
+            // eager path above has already found
+            try {
+                while (tokens.pull().type != END_OF_FILE) {
+                }
+            } catch (std::runtime_error &) {
+            }
+            parsing_failed(source, parser, e, lexer_errors, result);
+        }
+    }
+    return false;
+}
+
+Result compile(std::string_view source, const Options &options) {
+    return compile(source, options, Hooks());
+}
+
+Result compile(std::string_view source, const Options &options,
+               const Hooks &hooks) {
+    Result result;
+    PhaseTimer untimed(false, nullptr, "");
+    PhaseTimer &timer = hooks.timer ? *hooks.timer : untimed;
+
+    Interner interner;
+    Ast ast;
+    ast.interner = &interner;
+    if (!parse(source, options, timer, interner, ast, result)) {
+        return result;
+    }
+
+    if (options.print_parser) {
+        debug_print("Print AST");
+        std::ostringstream out;
+        AstPrinter().print(ast, out);
+        result.ast = out.str();
+    }
+
+    if (options.fold) {
+        debug_print("Fold constants");
+        timer.begin("fold");
+        try {
+            ConstantFolder folder;
+            ast = folder.fold(ast, &result.fold_stats);
+        } catch (std::exception &e) {
+            fail(result, "fold", e);
+            return result;
+        }
+        timer.end().nodes = ast.nodes.size();
+    }
+
+    if (options.print_folded) {
+        debug_print("Print folded AST");
+        std::ostringstream out;
+        AstPrinter().print(ast, out);
+        result.folded = out.str();
+    }
+
+    if (options.print_bytecode || options.run) {
+        debug_print("Compile bytecode");
+        timer.begin("bytecode");
+        Bytecode program;
+        try {
+            BytecodeCompiler compiler;
+            program = compiler.compile(ast);
+        } catch (std::exception &e) {
+            fail(result, "bytecode", e);
+            return result;
+        }
+        timer.end().instructions = program.code.size();
+
+        if (options.print_bytecode) {
+            debug_print("Print bytecode");
+            std::ostringstream out;
+            BytecodePrinter().print(program, out);
+            result.bytecode = out.str();
+        }
+        if (options.run) {
+            debug_print("Run bytecode");
+            timer.begin("run");
+            try {
+                // Truncated to the exit status like the exit syscall does
+                result.status = int(run_bytecode(program));
+            } catch (std::exception &e) {
+                fail(result, "run", e);
+            }
+            return result;
+        }
+    }
+
+    if (!options.output_assembly && !options.print_ir && !options.jit) {
+        return result;
+    }
+
+    debug_print("Build IR");
+    timer.begin("ir");
+    IrFunction ir;
+    try {
+        IrBuilder builder;
+        ir = builder.build(ast);
+    } catch (std::exception &e) {
+        fail(result, "ir", e);
+        return result;
+    }
+    PassManager::standard().run(ir);
+    if (timer.enabled()) {
+        int64_t instructions = 0;
+        for (const BasicBlock &block : ir.blocks) {
+            instructions += block.code.size();
+        }
+        timer.end().instructions = instructions;
+    }
+
+    if (options.print_ir) {
+        debug_print("Print IR");
+        std::ostringstream out;
+        IrPrinter().print(ir, out);
+        result.ir = out.str();
+    }
+
+    if (!options.output_assembly && !options.jit) {
+        return result;
+    }
+
+    // The JIT runs the code on this machine, so it picks the host target
+    const char *native = native_target();
+    if (options.jit && !native) {
+        fail(result, "run",
+             std::runtime_error("JIT: no target for this machine"));
+        return result;
+    }
+    std::string target = options.jit ? native : options.target;
+    std::unique_ptr<Backend> backend = make_backend(target);
+    if (!backend) {
+        fail(result, "codegen",
+             std::runtime_error("Unknown target: " + target));
+        return result;
+    }
+    timer.begin("codegen");
+    try {
+        if (options.jit) {
+            debug_print("Run in-process");
+            std::vector<uint8_t> code = backend->encode_function(ir);
+            PhaseStats &codegen = timer.end();
+            codegen.bytes = code.size();
+            codegen.instructions = backend->emitted;
+            timer.begin("run");
+            // Truncated to the exit status like the exit syscall does
+            result.status = int(run_jit(code));
+        } else if (options.emit == "asm") {
+            debug_print("Generate assembly");
+            std::unique_ptr<AsmWriter> writer =
+                hooks.assembly ? hooks.assembly()
+                               : std::make_unique<AsmWriter>(&result.assembly);
+            backend->generate(ir, *writer);
+            writer->flush();
+            PhaseStats &codegen = timer.end();
+            codegen.bytes = writer->bytes_written();
+            codegen.instructions = backend->emitted;
+        } else {
+            debug_print("Encode ELF");
+            ElfKind kind =
+                options.emit == "exe" ? ELF_EXECUTABLE : ELF_RELOCATABLE;
+            result.binary = build_elf(backend->encode(ir), kind);
+            PhaseStats &codegen = timer.end();
+            codegen.bytes = result.binary.size();
+            codegen.instructions = backend->emitted;
+        }
+    } catch (std::exception &e) {
+        fail(result, options.jit ? "run" : "codegen", e);
+    }
+    return result;
+}
+
+} // namespace ko
@@ -0,0 +1,78 @@
+#pragma once
+#include "fold.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class AsmWriter;
+class PhaseTimer;
+
+namespace ko {
+
+// What compile() produces, the library's own subset of the command line
+// flags
+struct Options {
+    bool print_parser = false;
+    bool print_folded = false;
+    bool print_ir = false;
+    bool print_bytecode = false;
+    bool fold = true;
+    bool output_assembly = true;
+    bool jit = false;
+    bool run = false;
+    std::string emit = "asm"; // asm, obj or exe
+    std::string target = "arm64";
+    // Threads a source is lexed on. With 0 or 1 it is lexed on the calling
+    // thread as the parser asks for tokens.
+    unsigned lex_threads = 1;
+};
+
+// One problem found while compiling. Lexer errors are reported and lexing
+// goes on, any other diagnostic ends the compile. The message is what
+// run.out prints for it.
+struct Diagnostic {
+    const char *phase; // lex, parse, fold, bytecode, run, ir or codegen
+    std::string message;
+    int line = 0; // 1-based, 0 when the phase has no position for it
+    int column = 0;
+};
+
+// What compile() produced. Only the outputs the options ask for are
+// filled in.
+struct Result {
+    int status = EXIT_SUCCESS; // the program's result for jit and run
+    std::string ast;           // print_parser
+    std::string folded;        // print_folded
+    std::string ir;            // print_ir
+    std::string bytecode;      // print_bytecode
+    std::string assembly;      // output_assembly with emit "asm"
+    std::vector<uint8_t> binary; // output_assembly with emit "obj" or "exe"
+    FoldStats fold_stats;
+    std::vector<Diagnostic> diagnostics; // in source order
+};
+
+// Compiles source text entirely in memory, the embeddable form of what
+// run.out does for one unit. Nothing is read from or written to files or
+// the standard streams. Safe to call from several threads at once. With
+// jit, the program runs in the calling process, on the target of this
+// machine whatever target says.
+Result compile(std::string_view source, const Options &options);
+
+// What run.out adds around a compile
+struct Hooks {
+    PhaseTimer *timer = nullptr; // times the phases
+    // Called when assembly is about to be generated, returns the writer it
+    // goes to instead of Result::assembly. May throw std::runtime_error.
+    std::function<std::unique_ptr<AsmWriter>()> assembly;
+};
+
+// compile() with hooks. With an enabled timer the source is lexed up
+// front, so that lexing and parsing are timed apart.
+Result compile(std::string_view source, const Options &options,
+               const Hooks &hooks);
+
+} // namespace ko
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+typedef uint32_t Reg;
+
+// Marks a missing register operand; instructions that accept an immediate
+// take it from `imm` when rhs is NO_REG
+const Reg NO_REG = UINT32_MAX;
+
+// ARM64 stack pointer, only used as the base of loads and stores and in
+// the add and sub that set up the frame
+const Reg SP = 31;
+
+enum MachineOp : uint8_t {
+    MI_MOV_IMM, // dst = imm
+    MI_MOVK,    // replace the 16-bit aligned chunk imm of dst, only
+                // introduced after register allocation
+    MI_MOV,     // dst = lhs
+    MI_ADD,     // dst = lhs + (rhs or imm)
+    MI_SUB,     // dst = lhs - (rhs or imm)
+    MI_MUL,     // dst = lhs * rhs
+    MI_SDIV,    // dst = lhs / rhs
+    MI_NEG,     // dst = -lhs
+    MI_CMP_SET, // dst = (lhs cond (rhs or imm)) ? 1 : 0
+    MI_LOAD,    // dst = stack slot at byte offset imm
+    MI_STORE,   // stack slot at byte offset imm = lhs
+    MI_RETURN,  // leave the program, or return to the caller when the
+                // function returns, with lhs as its result
+    MI_LEA,     // dst = lhs + rhs * scale + imm, lhs or rhs may be missing
+};
+
+enum Condition : uint8_t {
+    COND_EQ,
+    COND_NE,
+    COND_LT,
+    COND_LE,
+    COND_GT,
+    COND_GE,
+};
+
+struct MachineInstr {
+    MachineOp op;
+    Condition cond;
+    Reg dst;
+    Reg lhs;
+    Reg rhs;
+    int64_t imm;
+    uint8_t scale = 1; // of rhs in MI_LEA
+};
+
+inline bool defines_register(MachineOp op) {
+    return op != MI_STORE && op != MI_RETURN;
+}
+
+// Condition that holds after swapping the operands of a comparison
+inline Condition mirror(Condition cond) {
+    switch (cond) {
+    case COND_LT:
+        return COND_GT;
+    case COND_LE:
+        return COND_GE;
+    case COND_GT:
+        return COND_LT;
+    case COND_GE:
+        return COND_LE;
+    default:
+        return cond;
+    }
+}
+
+// Straight-line code of one function. Registers are virtual until
+// allocate_registers() maps them to the target's physical registers.
+struct MachineFunction {
+    std::vector<MachineInstr> code;
+    uint32_t vregs = 0;
+
+    // Frame layout chosen by the register allocator: spill slots from sp
+    // upwards, followed by the callee-saved registers the body clobbers
+    std::vector<Reg> saved;
+    uint32_t spill_slots = 0;
+    uint32_t frame_size = 0; // bytes, multiple of 16
+
+    bool returns = false; // called in-process instead of run as a program
+
+    Reg emit(MachineOp op, Reg lhs = NO_REG, Reg rhs = NO_REG, int64_t imm = 0,
+             Condition cond = COND_EQ, uint8_t scale = 1) {
+        Reg dst = defines_register(op) ? vregs++ : NO_REG;
+        code.push_back({op, cond, dst, lhs, rhs, imm, scale});
+        return dst;
+    }
+};
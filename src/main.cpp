@@ -1,8 +1,11 @@
-#include "codegen.hpp"
+#include "backend.hpp"
+#include "cache.hpp"
+#include "driver.hpp"
 #include "lexer.hpp"
-#include "parser.hpp"
-#include "printers/ast_printer.hpp"
-#include "util.hpp"
+#include "profile.hpp"
+#include "server.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -10,87 +13,339 @@
 #include <vector>
 
 int usage(const char *arg) {
-    std::cerr << "Usage: " << arg << " code.ko [--print=parser] [--no-assembly]"
+    std::cerr << "Usage: " << arg
+              << " code.ko... [@filelist] [-j N]"
+                 " [--print=parser|folded|ir|bytecode] [--no-fold] [--fold-stats]"
+                 " [--target=arm64|x86_64-linux] [--emit=asm|obj|exe] [-o file]"
+                 " [--no-assembly] [--jit] [--run]"
+                 " [--cache-dir=dir] [--cache-size=size] [--cache-stats]"
+                 " [--serve socket] [--time-phases] [--trace=file]"
+                 " [--lex-threads=N]"
               << std::endl;
     std::cerr << "Options:" << std::endl;
+    std::cerr << "  @filelist          Compile the files listed one per line"
+              << std::endl;
+    std::cerr << "  -j N               Compile units on N threads, each into "
+                 "its own file"
+              << std::endl;
     std::cerr << "  --print=parser     Print AST after parser phase"
               << std::endl;
-    std::cerr << "  --no-assembly      Disable ARM assembly generation "
+    std::cerr << "  --print=folded     Print AST after constant folding"
+              << std::endl;
+    std::cerr << "  --print=ir         Print IR after the optimization passes"
+              << std::endl;
+    std::cerr << "  --print=bytecode   Print the bytecode --run executes"
+              << std::endl;
+    std::cerr << "  --no-fold          Disable constant folding" << std::endl;
+    std::cerr << "  --fold-stats       Report nodes removed by constant folding"
+              << std::endl;
+    std::cerr << "  --target=arm64     ARM64, Darwin assembly and Linux ELF "
+                 "(default)"
+              << std::endl;
+    std::cerr << "  --target=x86_64-linux  x86-64 Linux" << std::endl;
+    std::cerr << "  --emit=asm         Print assembly (default)" << std::endl;
+    std::cerr << "  --emit=obj         Write an ELF relocatable object"
+              << std::endl;
+    std::cerr << "  --emit=exe         Write a static ELF executable"
+              << std::endl;
+    std::cerr << "  -o file            Output file instead of stdout, a.o or a.out"
+              << std::endl;
+    std::cerr << "  --no-assembly      Disable assembly generation "
                  "(enabled by default)"
               << std::endl;
+    std::cerr << "  --jit              Run the program in-process and exit "
+                 "with its result"
+              << std::endl;
+    std::cerr << "  --run              Run the program in the bytecode VM and "
+                 "exit with its result"
+              << std::endl;
+    std::cerr << "  --cache-dir=dir    Reuse outputs of earlier runs stored "
+                 "in dir"
+              << std::endl;
+    std::cerr << "  --cache-size=size  Cache limit in bytes, K, M or G "
+                 "suffix (default 1G)"
+              << std::endl;
+    std::cerr << "  --cache-stats      Report cache hits, misses and bytes "
+                 "saved"
+              << std::endl;
+    std::cerr << "  --serve socket     Compile requests sent to a Unix "
+                 "socket, with -j N threads"
+              << std::endl;
+    std::cerr << "  --time-phases      Report time, sizes and heap use of "
+                 "each phase"
+              << std::endl;
+    std::cerr << "  --trace=file       Write phases and units as Chrome "
+                 "trace events"
+              << std::endl;
+    std::cerr << "  --lex-threads=N    Lex a source in N chunks on N "
+                 "threads (default: every core from 1 MB)"
+              << std::endl;
 
     return EXIT_FAILURE;
 }
 
-void print_tokens(std::vector<Token> tokens) {
+void print_tokens(const TokenStream &tokens) {
     std::cout << "Tokens: " << std::endl;
     for (unsigned long i = 0; i < tokens.size(); i++) {
-        std::cout << tokens.at(i).text << " : " << tokens.at(i).type
+        std::cout << tokens.at(i).text << " : " << int(tokens.types[i])
                   << std::endl;
     }
     std::cout << std::endl;
 }
 
-std::vector<char> read_file(std::string filename) {
-    std::ifstream file(filename);
-    std::ostringstream ss;
-    ss << file.rdbuf();
-    const std::string &file_contents = ss.str();
-    std::vector<char> file_chars(file_contents.begin(), file_contents.end());
+// Output file of one unit when several are compiled: the source path
+// with .ko replaced by the extension of the output kind
+static std::string unit_output(const std::string &input,
+                               const std::string &emit) {
+    std::string base = input;
+    if (base.size() > 3 && base.compare(base.size() - 3, 3, ".ko") == 0) {
+        base.resize(base.size() - 3);
+    }
+    if (emit == "asm") {
+        return base + ".s";
+    }
+    if (emit == "obj") {
+        return base + ".o";
+    }
+    return base == input ? base + ".out" : base;
+}
 
-    return file_chars;
+// Paths listed one per line, blank lines are skipped
+static bool read_filelist(const std::string &path,
+                          std::vector<std::string> &inputs) {
+    std::ifstream list(path);
+    if (!list) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty()) {
+            inputs.push_back(line);
+        }
+    }
+    return true;
+}
+
+// Byte count with an optional K, M or G suffix, 0 when malformed
+static uint64_t parse_size(const std::string &text) {
+    char *end;
+    uint64_t size = strtoull(text.c_str(), &end, 10);
+    switch (*end) {
+    case 'G':
+        size <<= 10;
+        [[fallthrough]];
+    case 'M':
+        size <<= 10;
+        [[fallthrough]];
+    case 'K':
+        size <<= 10;
+        end++;
+        break;
+    }
+    return *end == '\0' ? size : 0;
+}
+
+struct UnitResult {
+    int status = EXIT_SUCCESS;
+    std::ostringstream out;
+    std::ostringstream err;
+};
+
+// Compiles every unit on a pool of jobs threads. Each unit writes into
+// its own buffers, which are printed in input order once all are done,
+// so the output does not depend on scheduling.
+static int compile_units(const std::vector<std::string> &inputs,
+                         const Options &options, unsigned jobs) {
+    std::vector<UnitResult> results(inputs.size());
+    {
+        ThreadPool pool(std::min<size_t>(jobs, inputs.size()));
+        for (size_t i = 0; i < inputs.size(); i++) {
+            pool.submit([&, i] {
+                Options unit = options;
+                unit.output = unit_output(inputs[i], options.emit);
+                UnitResult &result = results[i];
+                try {
+                    result.status =
+                        compile_unit(inputs[i], unit, result.out, result.err);
+                } catch (std::exception &e) {
+                    result.out << e.what() << std::endl;
+                    result.status = EXIT_FAILURE;
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        std::string out = results[i].out.str();
+        std::string err = results[i].err.str();
+        if (!out.empty()) {
+            std::cout << inputs[i] << ":\n" << out;
+        }
+        if (!err.empty()) {
+            std::cerr << inputs[i] << ":\n" << err;
+        }
+        if (results[i].status != EXIT_SUCCESS) {
+            status = EXIT_FAILURE;
+        }
+    }
+    std::cout.flush();
+    return status;
 }
 
 int main(int argc, char const *argv[]) {
-    if (argc < 2 || argc > 4) {
+    if (argc < 2) {
         return usage(argv[0]);
     }
 
-    std::string filename = argv[1];
-    bool print_parser = false;
-    bool output_assembly = true; // Default to true
+    Options options;
+    std::vector<std::string> inputs;
+    unsigned jobs = 0; // no -j given
+    bool filelist = false;
+    bool target_set = false;
+    bool lex_threads_set = false;
+    std::string cache_dir;
+    uint64_t cache_size = uint64_t(1) << 30;
+    bool cache_stats = false;
+    std::string serve_path;
+    std::string trace_path;
 
-    // Check for flags
-    for (int i = 2; i < argc; i++) {
+    for (int i = 1; i < argc; i++) {
         std::string flag = argv[i];
-        if (flag == "--print=parser") {
-            print_parser = true;
-        } else if (flag == "--no-assembly") {
-            output_assembly = false;
-        } else {
+        try {
+            if (apply_unit_flag(flag, options)) {
+                target_set |= flag.rfind("--target=", 0) == 0;
+                lex_threads_set |= flag.rfind("--lex-threads=", 0) == 0;
+                continue;
+            }
+        } catch (std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return usage(argv[0]);
+        }
+
+        if (flag == "-o" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (flag == "--time-phases") {
+            options.time_phases = true;
+        } else if (flag.rfind("--trace=", 0) == 0) {
+            trace_path = flag.substr(8);
+        } else if (flag == "--serve" && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else if (flag.rfind("--cache-dir=", 0) == 0) {
+            cache_dir = flag.substr(12);
+        } else if (flag.rfind("--cache-size=", 0) == 0) {
+            cache_size = parse_size(flag.substr(13));
+            if (cache_size == 0) {
+                std::cerr << "Invalid cache size: " << flag.substr(13)
+                          << std::endl;
+                return usage(argv[0]);
+            }
+        } else if (flag == "--cache-stats") {
+            cache_stats = true;
+        } else if (flag.rfind("-j", 0) == 0) {
+            std::string count = flag.size() > 2      ? flag.substr(2)
+                                : i + 1 < argc ? argv[++i]
+                                               : "";
+            jobs = std::atoi(count.c_str());
+            if (jobs == 0) {
+                std::cerr << "-j needs a thread count" << std::endl;
+                return usage(argv[0]);
+            }
+        } else if (flag[0] == '@') {
+            filelist = true;
+            if (!read_filelist(flag.substr(1), inputs)) {
+                std::cerr << "Cannot read file list: " << flag.substr(1)
+                          << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (flag[0] == '-') {
             std::cerr << "Unknown flag: " << flag << std::endl;
             return usage(argv[0]);
+        } else {
+            inputs.push_back(flag);
         }
     }
 
-    debug_print("Reading file");
-    std::vector<char> file_chars = read_file(filename);
+    if (!serve_path.empty() &&
+        (!inputs.empty() || options.jit || !options.output.empty())) {
+        std::cerr << "--serve takes no input files, --jit or -o" << std::endl;
+        return usage(argv[0]);
+    }
+    if (inputs.empty() && serve_path.empty()) {
+        std::cerr << "No input files" << std::endl;
+        return usage(argv[0]);
+    }
+
+    // The JIT runs the code on this machine, so it picks the host target
+    if (options.jit) {
+        const char *native = native_target();
+        if (!native || (target_set && options.target != native)) {
+            std::cerr << "--jit needs the target of this machine" << std::endl;
+            return usage(argv[0]);
+        }
+        options.target = native;
+    }
 
-    debug_print("Sending file to lexer");
-    std::vector<Token> tokens;
-    try {
-        tokens = lex(file_chars, tokens);
-    } catch (std::exception &e) {
-        std::cout << e.what() << std::endl;
-        return EXIT_FAILURE;
+    std::unique_ptr<Trace> trace;
+    if (!trace_path.empty()) {
+        trace = std::make_unique<Trace>();
+        options.trace = trace.get();
     }
 
-    debug_print("Parse tokens");
-    Parser parser;
-    auto ast = parser.parse(tokens);
+    std::unique_ptr<CompileCache> cache;
+    if (!cache_dir.empty()) {
+        try {
+            cache = std::make_unique<CompileCache>(cache_dir, cache_size);
+        } catch (std::exception &e) {
+            std::cout << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        options.cache = cache.get();
+    }
 
-    if (print_parser) {
-        debug_print("Print AST");
-        AstPrinter printer;
-        printer.print(ast.get());
+    // One unit keeps stdout for its output, a build of many units writes
+    // one file per unit
+    int status;
+    if (!serve_path.empty()) {
+        try {
+            status = serve(serve_path, options,
+                           jobs ? jobs : std::max(std::thread::hardware_concurrency(), 1u));
+        } catch (std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            status = EXIT_FAILURE;
+        }
+    } else if (inputs.size() == 1 && jobs == 0 && !filelist) {
+        // The only unit can lex a large source on every core
+        if (!lex_threads_set) {
+            options.lex_threads = 0;
+        }
+        status = compile_unit(inputs[0], options, std::cout, std::cerr);
+    } else if (options.jit || options.run || !options.output.empty()) {
+        std::cerr << "--jit, --run and -o take a single input file"
+                  << std::endl;
+        return usage(argv[0]);
+    } else {
+        status = compile_units(inputs, options, std::max(jobs, 1u));
     }
 
-    if (output_assembly) {
-        debug_print("Generate assembly");
-        CodeGenerator codegen;
-        std::string assembly = codegen.generate(ast.get());
-        std::cout << assembly;
+    if (trace) {
+        try {
+            trace->write(trace_path);
+        } catch (std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            status = EXIT_FAILURE;
+        }
     }
 
-    return EXIT_SUCCESS;
+    if (cache) {
+        CacheStats totals = cache->save();
+        if (cache_stats) {
+            std::cerr << "Cache: " << totals.hits << " hits, "
+                      << totals.misses << " misses, " << totals.bytes_saved
+                      << " bytes saved, " << totals.size << " bytes in use, "
+                      << totals.evicted << " entries evicted" << std::endl;
+        }
+    }
+    return status;
 }
@@ -0,0 +1,218 @@
+#include "lexer.hpp"
+#include "profile.hpp"
+#include "scan.hpp"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+// Tokens and errors of one chunk. Ids are the chunk's own until merged.
+struct Chunk {
+    size_t begin;
+    size_t end;
+    Interner interner;
+    TokenStream tokens;
+    std::vector<LexerError> errors; // lines counted from the chunk's start
+    bool failed = false;
+    std::exception_ptr exception;
+    std::vector<uint32_t> ids; // chunk id to merged id
+    size_t first_token = 0;    // index in the merged stream
+    HeapCounts heap;           // allocated on the chunk's thread
+};
+
+// Start of the next string literal at or after i, skipping comments, or
+// the end of the input
+static size_t next_string(std::string_view input, size_t i,
+                          const ScanKernels &scan) {
+    const char *begin = input.data();
+    const char *end = begin + input.size();
+    size_t quote = scan.find_quote(begin + i, end) - begin;
+    for (;;) {
+        size_t comment = input.substr(0, quote).find("//", i);
+        if (comment == std::string_view::npos) {
+            return quote;
+        }
+        i = scan.find_newline(begin + comment + 2, end) - begin;
+        // Searched again only when the quote was part of the comment
+        if (i > quote) {
+            quote = scan.find_quote(begin + i, end) - begin;
+        }
+    }
+}
+
+// Splits the input into up to chunks pieces of about the same size. Each
+// piece starts a line outside of any string literal, where the serial
+// lexer is between tokens. Comments end at the newline, so only strings
+// need to be tracked.
+static std::vector<size_t> split_lines(std::string_view input,
+                                       unsigned chunks) {
+    const ScanKernels &scan = scan_kernels();
+    const char *begin = input.data();
+    const char *end = begin + input.size();
+    std::vector<size_t> starts = {0};
+    size_t target = input.size() / chunks;
+    size_t i = 0;
+    while (starts.size() < chunks && i < input.size()) {
+        // Every line starting in [i, string] starts outside a string
+        size_t string = next_string(input, i, scan);
+        while (starts.size() < chunks) {
+            size_t from = std::max(i, target);
+            if (from >= string) {
+                break;
+            }
+            const void *newline =
+                memchr(begin + from, '\n', string - from);
+            if (!newline) {
+                break;
+            }
+            size_t start = static_cast<const char *>(newline) - begin + 1;
+            if (start >= input.size()) {
+                break;
+            }
+            starts.push_back(start);
+            target = std::max(start, input.size() * starts.size() / chunks);
+        }
+        if (string >= input.size()) {
+            break;
+        }
+        i = scan.find_quote(begin + string + 1, end) - begin + 1;
+    }
+    starts.push_back(input.size());
+    return starts;
+}
+
+// Lexes [begin, end) of the input with its own lexer. The lexer sees the
+// input up to end only, which ends a line, so every token offset is
+// already an offset in the whole input.
+static void lex_chunk(std::string_view input, Chunk &chunk) {
+    try {
+        std::ostringstream errors; // reported from the list after merging
+        Lexer l;
+        init_lexer(&l, input.substr(0, chunk.end), chunk.interner, errors);
+        l.error_list = &chunk.errors;
+        l.current = chunk.begin;
+        l.error_offset = chunk.begin;
+        l.error_line_start = chunk.begin;
+        chunk.tokens.source = input;
+        try {
+            while (next_token(&l)) {
+                chunk.tokens.push(l.token.type,
+                                  l.token.text.data() - input.data(),
+                                  l.token.text.size(), l.token.id);
+            }
+        } catch (std::runtime_error &) {
+            // Raised at the end of a chunk that had errors
+            chunk.failed = true;
+        }
+    } catch (...) {
+        chunk.exception = std::current_exception();
+    }
+}
+
+// Copies the chunk's tokens into their place in the merged stream, with
+// the merged ids
+static void merge_chunk(Chunk &chunk, TokenStream &tokens) {
+    const TokenStream &own = chunk.tokens;
+    size_t first = chunk.first_token;
+    std::copy(own.types.begin(), own.types.end(), tokens.types.begin() + first);
+    std::copy(own.offsets.begin(), own.offsets.end(),
+              tokens.offsets.begin() + first);
+    std::copy(own.lengths.begin(), own.lengths.end(),
+              tokens.lengths.begin() + first);
+    for (size_t i = 0; i < own.size(); i++) {
+        tokens.ids[first + i] = chunk.ids[own.ids[i]];
+    }
+    chunk.tokens = TokenStream();
+}
+
+// Runs work on every chunk, one thread each, the first on the caller's.
+// The other threads' allocations are counted as the caller's.
+static void for_each_chunk(std::vector<Chunk> &chunks,
+                           const std::function<void(Chunk &)> &work) {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < chunks.size(); i++) {
+        threads.emplace_back([&work, &chunk = chunks[i]] {
+            work(chunk);
+            chunk.heap = heap_counts();
+        });
+    }
+    work(chunks[0]);
+    for (size_t i = 1; i < chunks.size(); i++) {
+        threads[i - 1].join();
+        add_heap_counts(chunks[i].heap);
+    }
+}
+
+TokenStream lex_parallel(std::string_view input, Interner &interner,
+                         std::ostream &errors, unsigned chunks,
+                         std::vector<LexerError> *error_list,
+                         bool *failed) {
+    std::vector<size_t> starts = split_lines(input, std::max(chunks, 1u));
+    if (starts.size() <= 2) {
+        return lex(input, interner, errors, error_list, failed);
+    }
+
+    std::vector<Chunk> pieces(starts.size() - 1);
+    for (size_t i = 0; i < pieces.size(); i++) {
+        pieces[i].begin = starts[i];
+        pieces[i].end = starts[i + 1];
+    }
+    for_each_chunk(pieces, [&](Chunk &chunk) { lex_chunk(input, chunk); });
+
+    // Errors in input order with lines counted from the start of the input,
+    // as the serial lexer reports them
+    size_t line = 1;
+    size_t counted = 0; // lines are counted up to here
+    bool any_failed = false;
+    for (Chunk &chunk : pieces) {
+        if (chunk.exception) {
+            std::rethrow_exception(chunk.exception);
+        }
+        any_failed |= chunk.failed;
+        if (chunk.errors.empty()) {
+            continue;
+        }
+        line += std::count(input.begin() + counted,
+                           input.begin() + chunk.begin, '\n');
+        counted = chunk.begin;
+        for (const LexerError &error : chunk.errors) {
+            LexerError moved = {int(line) + error.line - 1, error.column};
+            lexer_error(errors, moved.line, moved.column);
+            if (error_list) {
+                error_list->push_back(moved);
+            }
+        }
+    }
+
+    // Interning each chunk's strings in the order of their chunk ids hands
+    // out the ids the serial lexer would, in order of first appearance. It
+    // interns them before failing too.
+    size_t count = 0;
+    for (Chunk &chunk : pieces) {
+        chunk.ids.resize(chunk.interner.size() + 1);
+        for (uint32_t id = 1; id < chunk.ids.size(); id++) {
+            chunk.ids[id] = interner.intern(chunk.interner.text(id));
+        }
+        chunk.first_token = count;
+        count += chunk.tokens.size();
+    }
+    if (failed) {
+        *failed = any_failed;
+    } else if (any_failed) {
+        throw std::runtime_error(
+            "Lexer error encountered. Terminating compilation");
+    }
+
+    TokenStream tokens;
+    tokens.source = input;
+    tokens.interner = &interner;
+    tokens.types.resize(count);
+    tokens.offsets.resize(count);
+    tokens.lengths.resize(count);
+    tokens.ids.resize(count);
+    for_each_chunk(pieces, [&](Chunk &chunk) { merge_chunk(chunk, tokens); });
+    return tokens;
+}
@@ -1,30 +1,23 @@
 #include "parser.hpp"
 #include "iostream"
 #include "lexer.hpp"
-#include "printers/ast_printer.hpp"
 #include "util.hpp"
-#include "visitor.hpp"
-#include <memory>
-
-std::string Binary::accept(Visitor *v) { return v->visit_binary_expr(this); }
-std::string Grouping::accept(Visitor *v) {
-    return v->visit_grouping_expr(this);
-}
-std::string Literal::accept(Visitor *v) { return v->visit_literal_expr(this); }
-std::string Unary::accept(Visitor *v) { return v->visit_unary_expr(this); }
+#include <charconv>
 
 /*
  * Parser Helper Methods
  */
 
-bool at_the_end(Parser *p) { return p->current == p->tokens.size(); }
+bool at_the_end(Parser *p) { return p->tokens->peek().type == END_OF_FILE; }
 
-Token previous(Parser *p) { return p->tokens.at(p->current - 1); }
+Token previous(Parser *p) { return p->tokens->previous(); }
+
+uint32_t previous_index(Parser *p) { return p->tokens->previous_index(); }
 
 void advance(Parser *p) {
     if (!at_the_end(p)) {
         debug_print("Advancing");
-        p->current++;
+        p->tokens->next();
     }
 }
 
@@ -33,157 +26,194 @@ bool same_type_as_curr_token(Parser *p, TokenType type) {
         return false;
     }
 
-    return type == p->tokens.at(p->current).type;
+    return type == p->tokens->peek().type;
 }
 
-bool match(Parser *p, std::vector<TokenType> v) {
-    for (unsigned long i = 0; i < v.size(); i++) {
-        if (same_type_as_curr_token(p, v.at(i))) {
-            /* debug_print(p->tokens.at(p->current).type); */
-            advance(p);
-            return true;
-        }
+bool match(Parser *p, TokenType type) {
+    if (same_type_as_curr_token(p, type)) {
+        advance(p);
+        return true;
     }
 
     return false;
 }
 
-void consume(Parser *p, TokenType type, std::string error_message) {
+void consume(Parser *p, TokenType type, const char *error_message) {
     if (same_type_as_curr_token(p, type)) {
         advance(p);
     } else {
+        p->error_token = p->tokens->index();
+        p->error_text = p->tokens->peek().text;
         throw std::runtime_error(error_message);
     }
 }
 
+// Integer value of a NUMBER token, the fraction of decimals is dropped
+int64_t parse_number(std::string_view text) {
+    int64_t value = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec != std::errc()) {
+        throw std::runtime_error("Number literal out of range: " +
+                                 std::string(text));
+    }
+    return value;
+}
+
 /*
- * Language Rules
+ * Binding Powers
+ *
+ * Infix operators bind with a left and a right power; an operator is taken
+ * as long as its left power is at least the minimum the caller asked for.
+ * Giving the right side one more than the left makes every level left
+ * associative. Adding an operator means adding a row here.
  */
-// TODO: Hold onto parser error instead of throwing. Skip to next statement and
-// continue parsing (synchronization)
 
-std::unique_ptr<Expression> primary(Parser *p) {
-    debug_print("Primary()");
-    std::vector<TokenType> types{FALSE};
-    if (match(p, types)) {
-        return std::unique_ptr<Literal>(new Literal(LT_BOOLEAN, false));
-    }
+struct BindingPower {
+    uint8_t left;
+    uint8_t right;
+};
 
-    types.at(0) = TRUE;
-    if (match(p, types)) {
-        return std::unique_ptr<Literal>(new Literal(LT_BOOLEAN, true));
-    }
+const uint8_t PREFIX_POWER = 9; // '!' and unary '-' bind tighter than infix
 
-    types.at(0) = _NULL;
-    if (match(p, types)) {
-        return std::unique_ptr<Literal>(new Literal(LT_NIL, true));
-    }
+constexpr BindingPower infix(uint8_t level) {
+    return {static_cast<uint8_t>(level * 2),
+            static_cast<uint8_t>(level * 2 + 1)};
+}
 
-    types.at(0) = NUMBER;
-    if (match(p, types)) {
-        return std::unique_ptr<Literal>(
-            new Literal(LT_NUMBER, std::stoi(previous(p).text)));
-    }
+struct BindingPowerTable {
+    BindingPower infix[END_OF_FILE + 1]; // {0, 0} for non operators
+};
+
+constexpr BindingPowerTable build_binding_powers() {
+    BindingPowerTable table = {};
+    table.infix[EQUAL_EQUAL] = infix(1);
+    table.infix[BANG_EQUAL] = infix(1);
+    table.infix[GREATER] = infix(2);
+    table.infix[GREATER_EQUAL] = infix(2);
+    table.infix[LESS] = infix(2);
+    table.infix[LESS_EQUAL] = infix(2);
+    table.infix[MINUS] = infix(3);
+    table.infix[PLUS] = infix(3);
+    table.infix[SLASH] = infix(4);
+    table.infix[STAR] = infix(4);
+    return table;
+}
 
-    types.at(0) = STRING;
-    if (match(p, types)) {
-        return std::unique_ptr<Literal>(
-            new Literal(LT_STRING, previous(p).text));
-    }
+constexpr BindingPowerTable binding_powers = build_binding_powers();
 
-    types.at(0) = LEFT_PAREN;
-    if (match(p, types)) {
-        auto expr = p->expression();
-        consume(p, RIGHT_PAREN, "Expected ')' after '('");
-        return std::unique_ptr<Grouping>(new Grouping(std::move(expr)));
-    }
+static_assert(binding_powers.infix[STAR].left < PREFIX_POWER,
+              "prefix operators must bind tighter than infix ones");
 
-    throw std::runtime_error(
-        "Parser error unhandled type in Expression.primary()");
+uint8_t prefix_operand_power() { return PREFIX_POWER; }
+
+uint8_t infix_operand_power(TokenType type) {
+    return binding_powers.infix[type].right;
 }
 
-std::unique_ptr<Expression> unary(Parser *p) {
-    debug_print("Unary()");
-    std::vector<TokenType> types{BANG, MINUS};
-    if (match(p, types)) {
-        Token oprt = previous(p);
-        auto right = unary(p);
-        return std::unique_ptr<Unary>(new Unary(oprt, std::move(right)));
-    }
+/*
+ * Language Rules
+ */
+// TODO: Hold onto parser error instead of throwing. Skip to next statement and
+// continue parsing (synchronization)
 
-    return primary(p);
-}
+NodeIndex expression_with_power(Parser *p, uint8_t min_power);
 
-std::unique_ptr<Expression> multiplication(Parser *p) {
-    debug_print("multiplication() - starting unary");
-    auto left = unary(p);
-    debug_print("multiplication() - finished unary");
-
-    std::vector<TokenType> types{SLASH, STAR};
-    while (match(p, types)) {
-        Token oprt = previous(p);
-        auto right = unary(p);
-        left = std::unique_ptr<Binary>(
-            new Binary(std::move(left), oprt, std::move(right)));
+NodeIndex primary(Parser *p) {
+    debug_print("Primary()");
+    Token token = p->tokens->peek();
+    advance(p);
+
+    uint32_t main_token = previous_index(p);
+    // Errors below are about this token, unless a nested rule says otherwise
+    p->error_token = main_token;
+    p->error_text = token.text;
+    switch (token.type) {
+    case FALSE:
+        return p->ast->add(NODE_BOOLEAN, FALSE, main_token, 0, 0);
+    case TRUE:
+        return p->ast->add(NODE_BOOLEAN, TRUE, main_token, 1, 0);
+    case _NULL:
+        return p->ast->add(NODE_NIL, _NULL, main_token, 0, 0);
+    case NUMBER:
+        return p->ast->add_number(main_token, parse_number(token.text));
+    case STRING:
+        return p->ast->add(NODE_STRING, STRING, main_token, token.id, 0);
+    case LEFT_PAREN: {
+        NodeIndex expr = p->expression();
+        consume(p, RIGHT_PAREN, "Expected ')' after '('");
+        return p->ast->add(NODE_GROUPING, LEFT_PAREN, main_token, expr, 0);
+    }
+    default:
+        throw std::runtime_error(
+            "Parser error unhandled type in Expression.primary()");
     }
-
-    return left;
 }
 
-std::unique_ptr<Expression> addition(Parser *p) {
-    debug_print("addition() - starting multiplication");
-    auto left = multiplication(p);
-    debug_print("addition() - finished multiplication");
-
-    std::vector<TokenType> types{MINUS, PLUS};
-    while (match(p, types)) {
-        Token oprt = previous(p);
-        auto right = multiplication(p);
-        left = std::unique_ptr<Binary>(
-            new Binary(std::move(left), oprt, std::move(right)));
+NodeIndex unary(Parser *p) {
+    debug_print("Unary()");
+    TokenType type = p->tokens->peek().type;
+    if (type == BANG || type == MINUS) {
+        advance(p);
+        uint32_t main_token = previous_index(p);
+        NodeIndex right = expression_with_power(p, PREFIX_POWER);
+        return p->ast->add(NODE_UNARY, type, main_token, right, 0);
     }
 
-    return left;
+    return primary(p);
 }
 
-std::unique_ptr<Expression> comparison(Parser *p) {
-    debug_print("comparison() - starting addition");
-    auto left = addition(p);
-    debug_print("comparison() - finished addition");
-
-    std::vector<TokenType> types{GREATER, GREATER_EQUAL, LESS, LESS_EQUAL};
-    while (match(p, types)) {
-        Token oprt = previous(p);
-        auto right = addition(p);
-        left = std::unique_ptr<Binary>(
-            new Binary(std::move(left), oprt, std::move(right)));
-    }
+// Precedence climbing: one loop step per operator, whatever its level
+NodeIndex expression_with_power(Parser *p, uint8_t min_power) {
+    NodeIndex left = unary(p);
 
-    return left;
-}
+    for (;;) {
+        TokenType type = p->tokens->peek().type;
+        BindingPower power = binding_powers.infix[type];
+        if (power.left == 0 || power.left < min_power) {
+            return left;
+        }
 
-std::unique_ptr<Expression> equality(Parser *p) {
-    debug_print("equality() - starting comparison");
-    auto left = comparison(p);
-    debug_print("equality() - finished comparison");
-    std::vector<TokenType> types{EQUAL_EQUAL, BANG_EQUAL};
-    while (match(p, types)) {
-        Token oprt = previous(p);
-        auto right = comparison(p);
-        left = std::unique_ptr<Binary>(
-            new Binary(std::move(left), oprt, std::move(right)));
+        advance(p);
+        uint32_t main_token = previous_index(p);
+        NodeIndex right = expression_with_power(p, power.right);
+        left = p->ast->add(NODE_BINARY, type, main_token, left, right);
     }
-    debug_print("equality() - finished equality");
-    return left;
 }
 
-std::unique_ptr<Expression> Parser::expression() { return equality(this); }
+NodeIndex Parser::expression() { return expression_with_power(this, 0); }
 
-std::unique_ptr<Expression> Parser::parse(std::vector<Token> tokens) {
-    this->tokens = tokens;
-    this->current = 0;
+NodeIndex Parser::parse(TokenSource &source, Ast &ast) {
+    TokenCursor cursor(source);
+    this->tokens = &cursor;
+    this->ast = &ast;
     auto e = expression();
+    ast.root = e;
+
+    // Trailing tokens are ignored, but still pulled so that lexer errors in
+    // the rest of the input are reported
+    while (!at_the_end(this)) {
+        advance(this);
+    }
+    this->tokens = nullptr;
+    this->ast = nullptr;
     debug_print("Parser complete");
 
     return e;
 }
+
+NodeIndex Parser::parse_range(const TokenStream &tokens, size_t first,
+                              size_t end, uint8_t min_power, Ast &ast) {
+    StreamSource source(tokens, first, end);
+    TokenCursor cursor(source, first);
+    this->tokens = &cursor;
+    this->ast = &ast;
+    NodeIndex e = expression_with_power(this, min_power);
+    bool complete = at_the_end(this);
+    this->tokens = nullptr;
+    this->ast = nullptr;
+
+    if (!complete) {
+        throw std::runtime_error("Parser error: tokens left after expression");
+    }
+    return e;
+}
@@ -1,68 +1,29 @@
 #pragma once
-#include "lexer.hpp"
-#include <memory>
-
-class Expression {
-  public:
-    virtual ~Expression(){};
-    virtual std::string accept(class Visitor *) { return ""; };
-};
+#include "ast.hpp"
+#include "token_source.hpp"
 
 class Parser {
   public:
-    std::vector<Token> tokens;
-    unsigned long current = 0;
-
-    std::unique_ptr<Expression> expression();
-    std::unique_ptr<Expression> parse(std::vector<Token> tokens);
-};
-
-class Binary : public Expression {
-  public:
-    std::unique_ptr<Expression> left;
-    Token oprt;
-    std::unique_ptr<Expression> right;
-
-    Binary(std::unique_ptr<Expression> left, Token oprt, std::unique_ptr<Expression> right)
-        : left(std::move(left)), oprt(oprt), right(std::move(right)) {}
-
-    std::string accept(class Visitor *);
-};
-
-class Grouping : public Expression {
-  public:
-    std::unique_ptr<Expression> inner_expr;
-    Grouping(std::unique_ptr<Expression> inner_expr) : inner_expr(std::move(inner_expr)) {}
-
-    std::string accept(class Visitor *);
-};
-
-enum LiteralType { LT_NUMBER, LT_STRING, LT_BOOLEAN, LT_NIL };
-
-class Literal : public Expression {
-  public:
-    int number;
-    std::string str;
-    bool boolean;
-    LiteralType literal_type;
-
-    Literal(LiteralType literal_type, int number)
-        : number(number), literal_type(literal_type) {}
-
-    Literal(LiteralType literal_type, std::string str)
-        : str(str), literal_type(literal_type) {}
-
-    Literal(LiteralType literal_type, bool boolean)
-        : boolean(boolean), literal_type(literal_type) {}
-
-    std::string accept(class Visitor *);
+    TokenCursor *tokens = nullptr;
+    Ast *ast = nullptr;
+    // Index of the token the last parse error was found at
+    uint32_t error_token = 0;
+    // Text of that token, pointing into the input
+    std::string_view error_text;
+
+    NodeIndex expression();
+    NodeIndex parse(TokenSource &source, Ast &ast);
+
+    // Parses tokens [first, end) of a stream as one expression, the way
+    // the operand of an operator with binding power min_power is parsed,
+    // and appends its nodes to ast. Nodes refer to tokens by their index
+    // in the whole stream. Throws unless the expression takes every token
+    // of the range.
+    NodeIndex parse_range(const TokenStream &tokens, size_t first, size_t end,
+                          uint8_t min_power, Ast &ast);
 };
 
-class Unary : public Expression {
-  public:
-    Token oprt;
-    std::unique_ptr<Expression> right;
-    Unary(Token oprt, std::unique_ptr<Expression> right) : oprt(oprt), right(std::move(right)) {}
-
-    std::string accept(class Visitor *);
-};
+// Binding power the operand of a prefix operator is parsed with
+uint8_t prefix_operand_power();
+// Binding power the right operand of an infix operator is parsed with
+uint8_t infix_operand_power(TokenType type);
@@ -1,50 +1,67 @@
 #include "ast_printer.hpp"
-#include "../parser.hpp"
+#include <charconv>
 #include <iostream>
-#include <string>
-
-std::string AstPrinter::parenthesize(std::string name,
-                         const std::vector<Expression *> exprs) {
-    std::string str("(");
-    str += name;
-    for (unsigned long i = 0; i < exprs.size(); i++) {
-        Expression *e = exprs.at(i);
-        str += " ";
-        str += e->accept(this);
-    }
-    str += ")";
 
-    return str;
+void AstPrinter::parenthesize(std::string_view name, NodeIndex only) {
+    out += '(';
+    out += name;
+    out += ' ';
+    visit(only);
+    out += ')';
+}
+
+void AstPrinter::parenthesize(std::string_view name, NodeIndex first,
+                              NodeIndex second) {
+    out += '(';
+    out += name;
+    out += ' ';
+    visit(first);
+    out += ' ';
+    visit(second);
+    out += ')';
 }
 
-void AstPrinter::print(Expression *expr) {
-    std::cout << expr->accept(this) << std::endl;
+void AstPrinter::print(const Ast &ast) { print(ast, std::cout); }
+
+void AstPrinter::print(const Ast &ast, std::ostream &stream) {
+    this->ast = &ast;
+    out.clear();
+    visit(ast.root);
+    out += '\n';
+    stream << out;
 }
 
-std::string AstPrinter::visit_binary_expr(Binary *expr) {
-    std::vector<Expression *> v{expr->left.get(), expr->right.get()};
-    return parenthesize(expr->oprt.text, v);
+void AstPrinter::visit_binary_expr(NodeIndex index) {
+    const Node &node = ast->at(index);
+    parenthesize(token_type_text(node.oprt), node.lhs, node.rhs);
 }
 
-std::string AstPrinter::visit_grouping_expr(Grouping *expr) {
-    std::vector<Expression *> v{expr->inner_expr.get()};
-    return parenthesize("group", v);
+void AstPrinter::visit_grouping_expr(NodeIndex index) {
+    parenthesize("group", ast->at(index).lhs);
 }
 
-std::string AstPrinter::visit_literal_expr(Literal *expr) {
-    switch (expr->literal_type) {
-    case LT_NUMBER:
-        return std::to_string(expr->number);
-    case LT_STRING:
-        return expr->str;
-    case LT_BOOLEAN:
-        return expr->boolean ? "true" : "false";
-    case LT_NIL:
-        return "nil";
+void AstPrinter::visit_literal_expr(NodeIndex index) {
+    const Node &node = ast->at(index);
+    switch (node.tag) {
+    case NODE_NUMBER: {
+        char digits[24];
+        auto result =
+            std::to_chars(digits, digits + sizeof(digits), ast->number(index));
+        out.append(digits, result.ptr);
+        break;
+    }
+    case NODE_STRING:
+        out += ast->string(index);
+        break;
+    case NODE_BOOLEAN:
+        out += node.lhs ? "true" : "false";
+        break;
+    default:
+        out += "nil";
     }
 }
 
-std::string AstPrinter::visit_unary_expr(Unary *expr) {
-    std::vector<Expression *> v{expr->right.get()};
-    return parenthesize(expr->oprt.text, v);
-}
\ No newline at end of file
+void AstPrinter::visit_unary_expr(NodeIndex index) {
+    const Node &node = ast->at(index);
+    parenthesize(token_type_text(node.oprt), node.lhs);
+}
@@ -1,19 +1,22 @@
 #pragma once
 #include "../visitor.hpp"
-#include <iostream>
+#include <iosfwd>
 #include <string>
-#include <vector>
 
-class Expression;
+// Prints the AST as s-expressions. Every visit appends to one output
+// buffer that is reused across print() calls.
+class AstPrinter : public Visitor<AstPrinter, void> {
+    std::string out;
 
-class AstPrinter : public Visitor {
-    std::string parenthesize(std::string name,
-                             const std::vector<Expression *> exprs);
+    void parenthesize(std::string_view name, NodeIndex first,
+                      NodeIndex second);
+    void parenthesize(std::string_view name, NodeIndex only);
 
   public:
-    void print(Expression *expr);
-    std::string visit_binary_expr(class Binary *expr);
-    std::string visit_grouping_expr(class Grouping *expr);
-    std::string visit_literal_expr(class Literal *expr);
-    std::string visit_unary_expr(class Unary *expr);
-};
\ No newline at end of file
+    void print(const Ast &ast);
+    void print(const Ast &ast, std::ostream &stream);
+    void visit_binary_expr(NodeIndex index);
+    void visit_grouping_expr(NodeIndex index);
+    void visit_literal_expr(NodeIndex index);
+    void visit_unary_expr(NodeIndex index);
+};
@@ -0,0 +1,39 @@
+#include "bytecode_printer.hpp"
+#include <iostream>
+
+static std::string reg(uint8_t number) { return "r" + std::to_string(number); }
+
+void BytecodePrinter::print(const Bytecode &program) { print(program, std::cout); }
+
+void BytecodePrinter::print(const Bytecode &program, std::ostream &stream) {
+    out.clear();
+    const std::vector<BytecodeInstr> &code = program.code;
+    for (size_t i = 0; i < code.size(); i++) {
+        const BytecodeInstr &instr = code[i];
+        out += "    ";
+        if (instr.op == OP_RET) {
+            out += "ret " + reg(instr.a) + '\n';
+            continue;
+        }
+        out += reg(instr.dst) + " = " + bytecode_op_text(instr.op) + ' ';
+
+        switch (instr.op) {
+        case OP_LOADK:
+            out += std::to_string(program.constants[instr.a | instr.b << 8]);
+            break;
+        case OP_LOADK_WIDE:
+            out += std::to_string(program.constants[wide_index(code[++i])]);
+            break;
+        case OP_NEG:
+        case OP_NOT:
+            out += reg(instr.a);
+            break;
+        default:
+            out += reg(instr.a) + ", ";
+            out += instr.op >= OP_ADDK ? std::to_string(program.constants[instr.b])
+                                       : reg(instr.b);
+        }
+        out += '\n';
+    }
+    stream << out;
+}
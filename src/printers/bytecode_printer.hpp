@@ -0,0 +1,14 @@
+#pragma once
+#include "../vm/bytecode.hpp"
+#include <iosfwd>
+#include <string>
+
+// Prints bytecode one instruction per line, K operands and loaded
+// constants by value.
+class BytecodePrinter {
+    std::string out;
+
+  public:
+    void print(const Bytecode &program);
+    void print(const Bytecode &program, std::ostream &stream);
+};
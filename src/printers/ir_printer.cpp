@@ -0,0 +1,47 @@
+#include "ir_printer.hpp"
+#include <iostream>
+
+void IrPrinter::value(Value value) {
+    out += '%';
+    out += std::to_string(numbers[value]);
+}
+
+void IrPrinter::print(const IrFunction &function) { print(function, std::cout); }
+
+void IrPrinter::print(const IrFunction &function, std::ostream &stream) {
+    out.clear();
+    numbers.assign(function.values.size(), 0);
+
+    uint32_t next = 0;
+    for (size_t b = 0; b < function.blocks.size(); b++) {
+        out += "b" + std::to_string(b) + ":\n";
+        for (Value v : function.blocks[b].code) {
+            const IrInstr &instr = function.at(v);
+            out += "    ";
+            if (instr.type != IR_VOID) {
+                numbers[v] = next++;
+                value(v);
+                out += " = ";
+            }
+            out += ir_op_text(instr.op);
+            if (instr.type != IR_VOID) {
+                out += ' ';
+                out += ir_type_text(instr.type);
+            }
+            if (instr.op == IR_CONST) {
+                out += ' ';
+                out += std::to_string(instr.imm);
+            }
+            if (instr.lhs != NO_VALUE) {
+                out += ' ';
+                value(instr.lhs);
+            }
+            if (instr.rhs != NO_VALUE) {
+                out += ", ";
+                value(instr.rhs);
+            }
+            out += '\n';
+        }
+    }
+    stream << out;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "../ir/ir.hpp"
+#include <iosfwd>
+#include <string>
+
+// Prints a function one instruction per line. Values are renumbered in
+// the order they appear, so the gaps left by removed instructions do not
+// show up in the output.
+class IrPrinter {
+    std::string out;
+    std::vector<uint32_t> numbers;
+
+    void value(Value value);
+
+  public:
+    void print(const IrFunction &function);
+    void print(const IrFunction &function, std::ostream &stream);
+};
@@ -0,0 +1,196 @@
+#include "profile.hpp"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+typedef std::chrono::steady_clock Clock;
+
+static thread_local HeapCounts heap;
+
+// Enabled timers, allocations are only counted while there are any
+static std::atomic<int> counting{0};
+
+void count_allocation(size_t size) {
+    if (counting.load(std::memory_order_relaxed) > 0) {
+        heap.allocations++;
+        heap.bytes += size;
+    }
+}
+
+void add_heap_counts(HeapCounts counts) {
+    heap.allocations += counts.allocations;
+    heap.bytes += counts.bytes;
+}
+
+HeapCounts heap_counts() { return heap; }
+
+static const Clock::time_point process_start = Clock::now();
+
+double trace_clock() {
+    return std::chrono::duration<double, std::micro>(Clock::now() -
+                                                     process_start)
+        .count();
+}
+
+// Small dense numbers name the threads in the trace viewer
+static int thread_number() {
+    static std::atomic<int> next{1};
+    static thread_local int number = next++;
+    return number;
+}
+
+static std::string json_string(const std::string &text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void Trace::add(const std::string &name, const char *category, double start,
+                double duration, const std::string &args) {
+    int thread = thread_number();
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back({name, category, start, duration, thread, args});
+}
+
+void Trace::write(const std::string &path) const {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+    for (size_t i = 0; i < events.size(); i++) {
+        const Event &event = events[i];
+        out << "{\"name\":" << json_string(event.name) << ",\"cat\":\""
+            << event.category << "\",\"ph\":\"X\",\"ts\":" << event.start
+            << ",\"dur\":" << event.duration
+            << ",\"pid\":1,\"tid\":" << event.thread << ",\"args\":{"
+            << event.args << "}}" << (i + 1 < events.size() ? ",\n" : "\n");
+    }
+    out << "],\"displayTimeUnit\":\"ms\"}\n";
+    if (!out.flush()) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+}
+
+PhaseTimer::PhaseTimer(bool report, Trace *trace, std::string unit)
+    : report(report), trace(trace), unit(std::move(unit)) {
+    start = enabled() ? trace_clock() : 0;
+    if (enabled()) {
+        counting++;
+    }
+}
+
+PhaseTimer::~PhaseTimer() {
+    if (enabled()) {
+        counting--;
+    }
+}
+
+void PhaseTimer::begin(const char *name) {
+    if (!enabled()) {
+        return;
+    }
+    if (running) {
+        end();
+    }
+    PhaseStats phase;
+    phase.name = name;
+    heap_start = heap_counts();
+    phase.start = trace_clock();
+    phases.push_back(phase);
+    running = true;
+}
+
+PhaseStats &PhaseTimer::end() {
+    if (!running) {
+        return unused;
+    }
+    PhaseStats &phase = phases.back();
+    phase.duration = trace_clock() - phase.start;
+    HeapCounts now = heap_counts();
+    phase.heap.allocations = now.allocations - heap_start.allocations;
+    phase.heap.bytes = now.bytes - heap_start.bytes;
+    running = false;
+    return phase;
+}
+
+// A count, or "-" when it does not apply
+static std::string count(int64_t value) {
+    return value < 0 ? "-" : std::to_string(value);
+}
+
+void PhaseTimer::finish(int status, std::ostream &out) {
+    if (!enabled()) {
+        return;
+    }
+    end();
+    double duration = trace_clock() - start;
+
+    if (report) {
+        // Formatted apart so out keeps its own flags
+        std::ostringstream table;
+        table << std::left << std::setw(10) << "phase" << std::right
+            << std::setw(10) << "ms" << std::setw(11) << "bytes"
+            << std::setw(10) << "tokens" << std::setw(10) << "nodes"
+            << std::setw(10) << "instrs" << std::setw(10) << "allocs"
+            << std::setw(13) << "alloc bytes" << '\n';
+        HeapCounts total;
+        for (const PhaseStats &phase : phases) {
+            table << std::left << std::setw(10) << phase.name << std::right
+                << std::setw(10) << std::fixed << std::setprecision(3)
+                << phase.duration / 1000 << std::setw(11)
+                << count(phase.bytes) << std::setw(10) << count(phase.tokens)
+                << std::setw(10) << count(phase.nodes) << std::setw(10)
+                << count(phase.instructions) << std::setw(10)
+                << phase.heap.allocations << std::setw(13) << phase.heap.bytes
+                << '\n';
+            total.allocations += phase.heap.allocations;
+            total.bytes += phase.heap.bytes;
+        }
+        table << std::left << std::setw(10) << "total" << std::right
+            << std::setw(10) << duration / 1000 << std::setw(61)
+            << total.allocations << std::setw(13) << total.bytes
+            << '\n';
+        out << table.str() << std::flush;
+    }
+
+    if (trace) {
+        for (const PhaseStats &phase : phases) {
+            std::ostringstream args;
+            const char *separator = "";
+            auto arg = [&](const char *name, int64_t value) {
+                if (value >= 0) {
+                    args << separator << '"' << name << "\":" << value;
+                    separator = ",";
+                }
+            };
+            arg("bytes", phase.bytes);
+            arg("tokens", phase.tokens);
+            arg("nodes", phase.nodes);
+            arg("instructions", phase.instructions);
+            arg("allocations", phase.heap.allocations);
+            arg("allocated_bytes", phase.heap.bytes);
+            trace->add(phase.name, "phase", phase.start, phase.duration,
+                       args.str());
+        }
+        trace->add(unit, "unit", start, duration,
+                   "\"status\":" + std::to_string(status));
+    }
+}
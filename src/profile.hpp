@@ -0,0 +1,96 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Heap allocations made by the calling thread so far, counted while any
+// PhaseTimer is enabled. Only programs linking heap_hook.cpp count them,
+// of the others they stay zero.
+struct HeapCounts {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+HeapCounts heap_counts();
+
+// Called by the operator new of heap_hook.cpp
+void count_allocation(size_t size);
+
+// Adds what another thread allocated on behalf of the calling one, like
+// the chunk threads of lex_parallel(), to the calling thread's counts
+void add_heap_counts(HeapCounts counts);
+
+// Microseconds since the process started, the clock of every trace event
+double trace_clock();
+
+// Chrome trace events of a whole run, written as JSON for chrome://tracing
+// or Perfetto. Safe to add to from several threads.
+class Trace {
+  public:
+    // A complete event on the calling thread's track. args is the body of
+    // a JSON object, without the braces.
+    void add(const std::string &name, const char *category, double start,
+             double duration, const std::string &args);
+
+    // Throws std::runtime_error when the file cannot be written
+    void write(const std::string &path) const;
+
+  private:
+    struct Event {
+        std::string name;
+        const char *category;
+        double start;
+        double duration;
+        int thread;
+        std::string args;
+    };
+
+    mutable std::mutex mutex; // guards events
+    std::vector<Event> events;
+};
+
+// Counts of one phase, -1 where they do not apply to it
+struct PhaseStats {
+    const char *name;
+    double start = 0;
+    double duration = 0;
+    int64_t bytes = -1;
+    int64_t tokens = -1;
+    int64_t nodes = -1;
+    int64_t instructions = -1;
+    HeapCounts heap;
+};
+
+// Times the phases of one unit for --time-phases and --trace. Does
+// nothing when neither is enabled.
+class PhaseTimer {
+  public:
+    PhaseTimer(bool report, Trace *trace, std::string unit);
+    ~PhaseTimer();
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+    bool enabled() const { return report || trace; }
+
+    // Ends the running phase, if any, and starts the next one
+    void begin(const char *name);
+    // Ends the running phase and returns it so its counts can be filled in
+    PhaseStats &end();
+
+    // Ends the unit: prints the table to out and adds the unit's events to
+    // the trace
+    void finish(int status, std::ostream &out);
+
+  private:
+    bool report;
+    Trace *trace;
+    std::string unit;
+    double start;
+    std::vector<PhaseStats> phases;
+    bool running = false;
+    HeapCounts heap_start;
+    PhaseStats unused;
+};
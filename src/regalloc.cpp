@@ -0,0 +1,142 @@
+#include "regalloc.hpp"
+#include <algorithm>
+
+struct Interval {
+    Reg vreg;
+    uint32_t start; // defining instruction
+    uint32_t end;   // last instruction that reads the value
+};
+
+// Where a virtual register lives for its whole interval
+struct Location {
+    bool spilled;
+    uint32_t index; // position in the register pool, or spill slot
+};
+
+static std::vector<Interval> live_intervals(const MachineFunction &fn) {
+    std::vector<Interval> intervals(fn.vregs);
+    for (uint32_t i = 0; i < fn.code.size(); i++) {
+        const MachineInstr &instr = fn.code[i];
+        if (instr.lhs != NO_REG) {
+            intervals[instr.lhs].end = i;
+        }
+        if (instr.rhs != NO_REG) {
+            intervals[instr.rhs].end = i;
+        }
+        if (instr.dst != NO_REG) {
+            intervals[instr.dst] = {instr.dst, i, i};
+        }
+    }
+
+    std::sort(intervals.begin(), intervals.end(),
+              [](const Interval &a, const Interval &b) {
+                  return a.start < b.start;
+              });
+    return intervals;
+}
+
+static std::vector<Location> linear_scan(MachineFunction &fn, size_t pool) {
+    std::vector<Location> locations(fn.vregs);
+    std::vector<bool> free(pool, true);
+    std::vector<Interval> active; // sorted by increasing end
+
+    for (const Interval &current : live_intervals(fn)) {
+        // Registers whose value was last read by the defining instruction
+        // can be reused for its result
+        while (!active.empty() && active.front().end <= current.start) {
+            free[locations[active.front().vreg].index] = true;
+            active.erase(active.begin());
+        }
+
+        Location location;
+        auto reg = std::find(free.begin(), free.end(), true);
+        if (reg != free.end()) {
+            *reg = false;
+            location = {false, uint32_t(reg - free.begin())};
+        } else if (active.back().end > current.end) {
+            // Spill whichever value stays live the longest
+            location = locations[active.back().vreg];
+            locations[active.back().vreg] = {true, fn.spill_slots++};
+            active.pop_back();
+        } else {
+            locations[current.vreg] = {true, fn.spill_slots++};
+            continue;
+        }
+
+        locations[current.vreg] = location;
+        auto position = std::upper_bound(
+            active.begin(), active.end(), current,
+            [](const Interval &a, const Interval &b) { return a.end < b.end; });
+        active.insert(position, current);
+    }
+    return locations;
+}
+
+void allocate_registers(MachineFunction &fn, const RegisterSet &registers) {
+    std::vector<Reg> pool = registers.caller_saved;
+    pool.insert(pool.end(), registers.callee_saved.begin(),
+                registers.callee_saved.end());
+
+    std::vector<Location> locations = linear_scan(fn, pool.size());
+
+    std::vector<bool> used(pool.size(), false);
+    for (const Location &location : locations) {
+        if (!location.spilled) {
+            used[location.index] = true;
+        }
+    }
+    fn.saved.clear();
+    for (size_t i = registers.caller_saved.size(); i < pool.size(); i++) {
+        if (used[i]) {
+            fn.saved.push_back(pool[i]);
+        }
+    }
+
+    auto slot = [](const Location &location) {
+        return int64_t(location.index) * 8;
+    };
+
+    std::vector<MachineInstr> code;
+    code.reserve(fn.code.size());
+    for (MachineInstr instr : fn.code) {
+        int next_scratch = 0;
+        auto use = [&](Reg &reg) {
+            const Location &location = locations[reg];
+            if (!location.spilled) {
+                reg = pool[location.index];
+                return;
+            }
+            Reg scratch = registers.scratch[next_scratch++];
+            code.push_back({MI_LOAD, COND_EQ, scratch, NO_REG, NO_REG,
+                            slot(location)});
+            reg = scratch;
+        };
+
+        if (instr.lhs != NO_REG) {
+            use(instr.lhs);
+        }
+        if (instr.rhs != NO_REG) {
+            use(instr.rhs);
+        }
+
+        if (instr.dst == NO_REG) {
+            code.push_back(instr);
+            continue;
+        }
+
+        const Location &location = locations[instr.dst];
+        if (!location.spilled) {
+            instr.dst = pool[location.index];
+            code.push_back(instr);
+            continue;
+        }
+        instr.dst = registers.scratch[0];
+        code.push_back(instr);
+        code.push_back({MI_STORE, COND_EQ, NO_REG, instr.dst, NO_REG,
+                        slot(location)});
+    }
+    fn.code = std::move(code);
+
+    uint32_t bytes = (fn.spill_slots + fn.saved.size()) * 8;
+    fn.frame_size = (bytes + 15) & ~15u;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "machine.hpp"
+
+// Physical registers the allocator may hand out
+struct RegisterSet {
+    std::vector<Reg> caller_saved; // free to clobber, tried first
+    std::vector<Reg> callee_saved; // saved in the prologue once used
+    Reg scratch[2];                // reserved for reloading spilled values
+};
+
+// Linear scan over the live intervals of the virtual registers in fn.
+// Rewrites fn.code to physical registers, with loads and stores around the
+// uses and definitions of values that had to be spilled to the frame.
+void allocate_registers(MachineFunction &fn, const RegisterSet &registers);
@@ -0,0 +1,269 @@
+#include "scan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// clang-format off
+#define SP CC_SPACE
+#define DG CC_DIGIT
+#define AL CC_ALPHA
+const uint8_t char_class[256] = {
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  SP, SP, 0,  0,  SP, 0,  0,  // 0x00
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0x10
+    SP, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0x20
+    DG, DG, DG, DG, DG, DG, DG, DG, DG, DG, 0,  0,  0,  0,  0,  0,  // 0x30
+    0,  AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, // 0x40
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, 0,  0,  0,  0,  0,  // 0x50
+    0,  AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, // 0x60
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, 0,  0,  0,  0,  0,  // 0x70
+    // 0x80 - 0xff are all zero
+};
+#undef SP
+#undef DG
+#undef AL
+// clang-format on
+
+/*
+ * Scalar kernels, also used for the tails of the vector kernels
+ */
+
+static const char *skip_class_scalar(const char *p, const char *end,
+                                     uint8_t cls) {
+    while (p < end && has_class(*p, cls)) {
+        p++;
+    }
+    return p;
+}
+
+static const char *find_byte_scalar(const char *p, const char *end, char c) {
+    while (p < end && *p != c) {
+        p++;
+    }
+    return p;
+}
+
+static const char *skip_whitespace_scalar(const char *p, const char *end) {
+    return skip_class_scalar(p, end, CC_SPACE);
+}
+
+static const char *skip_digits_scalar(const char *p, const char *end) {
+    return skip_class_scalar(p, end, CC_DIGIT);
+}
+
+static const char *skip_alnum_scalar(const char *p, const char *end) {
+    return skip_class_scalar(p, end, CC_ALNUM);
+}
+
+static const char *find_newline_scalar(const char *p, const char *end) {
+    return find_byte_scalar(p, end, '\n');
+}
+
+static const char *find_quote_scalar(const char *p, const char *end) {
+    return find_byte_scalar(p, end, '"');
+}
+
+#ifdef SCAN_X86
+
+/*
+ * SSE2 kernels, 16 bytes per step. SSE2 is part of the x86-64 baseline.
+ * Each block produces a mask with one bit per byte that belongs to the
+ * run; the first zero bit is where the run ends.
+ */
+
+// Bytes in [lo, lo + span] as an unsigned comparison
+static inline __m128i in_range_sse2(__m128i v, char lo, char span) {
+    __m128i bound = _mm_set1_epi8(span);
+    __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_max_epu8(shifted, bound), bound);
+}
+
+static inline unsigned whitespace_mask_sse2(__m128i v) {
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    return _mm_movemask_epi8(m);
+}
+
+static inline unsigned digit_mask_sse2(__m128i v) {
+    return _mm_movemask_epi8(in_range_sse2(v, '0', 9));
+}
+
+static inline unsigned alnum_mask_sse2(__m128i v) {
+    // Setting bit 5 folds upper case letters onto lower case ones
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i m = _mm_or_si128(in_range_sse2(v, '0', 9),
+                             in_range_sse2(lower, 'a', 'z' - 'a'));
+    return _mm_movemask_epi8(m);
+}
+
+// Skip while the mask bits are set, 16 bytes at a time
+#define SKIP_SSE2(mask_fn, scalar_fn)                                          \
+    while (end - p >= 16) {                                                    \
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));     \
+        unsigned run = mask_fn(v) ^ 0xffff;                                    \
+        if (run) {                                                             \
+            return p + __builtin_ctz(run);                                     \
+        }                                                                      \
+        p += 16;                                                               \
+    }                                                                          \
+    return scalar_fn(p, end);
+
+// Stop at the first byte equal to c, 16 bytes at a time
+#define FIND_SSE2(c, scalar_fn)                                                \
+    __m128i needle = _mm_set1_epi8(c);                                         \
+    while (end - p >= 16) {                                                    \
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));     \
+        unsigned hit = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));           \
+        if (hit) {                                                             \
+            return p + __builtin_ctz(hit);                                     \
+        }                                                                      \
+        p += 16;                                                               \
+    }                                                                          \
+    return scalar_fn(p, end);
+
+static const char *skip_whitespace_sse2(const char *p, const char *end) {
+    SKIP_SSE2(whitespace_mask_sse2, skip_whitespace_scalar)
+}
+
+static const char *skip_digits_sse2(const char *p, const char *end) {
+    SKIP_SSE2(digit_mask_sse2, skip_digits_scalar)
+}
+
+static const char *skip_alnum_sse2(const char *p, const char *end) {
+    SKIP_SSE2(alnum_mask_sse2, skip_alnum_scalar)
+}
+
+static const char *find_newline_sse2(const char *p, const char *end) {
+    FIND_SSE2('\n', find_newline_scalar)
+}
+
+static const char *find_quote_sse2(const char *p, const char *end) {
+    FIND_SSE2('"', find_quote_scalar)
+}
+
+/*
+ * AVX2 kernels, 32 bytes per step, compiled for AVX2 only in this file and
+ * only called once cpuid reports support
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i in_range_avx2(__m256i v, char lo, char span) {
+    __m256i bound = _mm256_set1_epi8(span);
+    __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_max_epu8(shifted, bound), bound);
+}
+
+AVX2 static inline unsigned whitespace_mask_avx2(__m256i v) {
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+    return _mm256_movemask_epi8(m);
+}
+
+AVX2 static inline unsigned digit_mask_avx2(__m256i v) {
+    return _mm256_movemask_epi8(in_range_avx2(v, '0', 9));
+}
+
+AVX2 static inline unsigned alnum_mask_avx2(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i m = _mm256_or_si256(in_range_avx2(v, '0', 9),
+                                in_range_avx2(lower, 'a', 'z' - 'a'));
+    return _mm256_movemask_epi8(m);
+}
+
+#define SKIP_AVX2(mask_fn, sse2_fn)                                            \
+    while (end - p >= 32) {                                                    \
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));  \
+        unsigned run = ~mask_fn(v);                                            \
+        if (run) {                                                             \
+            return p + __builtin_ctz(run);                                     \
+        }                                                                      \
+        p += 32;                                                               \
+    }                                                                          \
+    return sse2_fn(p, end);
+
+#define FIND_AVX2(c, sse2_fn)                                                  \
+    __m256i needle = _mm256_set1_epi8(c);                                      \
+    while (end - p >= 32) {                                                    \
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));  \
+        unsigned hit = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));     \
+        if (hit) {                                                             \
+            return p + __builtin_ctz(hit);                                     \
+        }                                                                      \
+        p += 32;                                                               \
+    }                                                                          \
+    return sse2_fn(p, end);
+
+AVX2 static const char *skip_whitespace_avx2(const char *p, const char *end) {
+    SKIP_AVX2(whitespace_mask_avx2, skip_whitespace_sse2)
+}
+
+AVX2 static const char *skip_digits_avx2(const char *p, const char *end) {
+    SKIP_AVX2(digit_mask_avx2, skip_digits_sse2)
+}
+
+AVX2 static const char *skip_alnum_avx2(const char *p, const char *end) {
+    SKIP_AVX2(alnum_mask_avx2, skip_alnum_sse2)
+}
+
+AVX2 static const char *find_newline_avx2(const char *p, const char *end) {
+    FIND_AVX2('\n', find_newline_sse2)
+}
+
+AVX2 static const char *find_quote_avx2(const char *p, const char *end) {
+    FIND_AVX2('"', find_quote_sse2)
+}
+
+#endif // SCAN_X86
+
+static const ScanKernels scalar_kernels = {
+    "scalar",           skip_whitespace_scalar, skip_digits_scalar,
+    skip_alnum_scalar,  find_newline_scalar,    find_quote_scalar,
+};
+
+#ifdef SCAN_X86
+static const ScanKernels sse2_kernels = {
+    "sse2",          skip_whitespace_sse2, skip_digits_sse2,
+    skip_alnum_sse2, find_newline_sse2,    find_quote_sse2,
+};
+
+static const ScanKernels avx2_kernels = {
+    "avx2",          skip_whitespace_avx2, skip_digits_avx2,
+    skip_alnum_avx2, find_newline_avx2,    find_quote_avx2,
+};
+#endif
+
+static ScanLevel best_level() {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SCAN_AVX2;
+    }
+    return SCAN_SSE2;
+#else
+    return SCAN_SCALAR;
+#endif
+}
+
+const ScanKernels &scan_kernels(ScanLevel level) {
+    static const ScanLevel best = best_level();
+    if (level > best) {
+        level = best;
+    }
+
+    switch (level) {
+#ifdef SCAN_X86
+    case SCAN_AVX2:
+        return avx2_kernels;
+    case SCAN_SSE2:
+        return sse2_kernels;
+#endif
+    default:
+        return scalar_kernels;
+    }
+}
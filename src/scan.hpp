@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+// Character classes used by the lexer. Every byte of the input is looked
+// up in char_class, both by the scalar kernels and by the lexer itself.
+enum CharClass : uint8_t {
+    CC_SPACE = 1 << 0, // ' ', '\t', '\r' and '\n'
+    CC_DIGIT = 1 << 1,
+    CC_ALPHA = 1 << 2,
+    CC_ALNUM = CC_DIGIT | CC_ALPHA,
+};
+
+extern const uint8_t char_class[256];
+
+inline bool has_class(const char c, const uint8_t cls) {
+    return char_class[static_cast<unsigned char>(c)] & cls;
+}
+
+// Scanning kernels for the hot loops of the lexer. Each one returns the
+// first position in [p, end) that is not part of the run, or end.
+struct ScanKernels {
+    const char *name;
+    const char *(*skip_whitespace)(const char *p, const char *end);
+    const char *(*skip_digits)(const char *p, const char *end);
+    const char *(*skip_alnum)(const char *p, const char *end);
+    // Comment bodies stop at '\n', string bodies at '"'
+    const char *(*find_newline)(const char *p, const char *end);
+    const char *(*find_quote)(const char *p, const char *end);
+};
+
+enum ScanLevel { SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2, SCAN_BEST };
+
+// Kernels for the requested level, falling back to the best level the CPU
+// supports. The default is picked once at startup from cpuid.
+const ScanKernels &scan_kernels(ScanLevel level = SCAN_BEST);
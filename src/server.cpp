@@ -0,0 +1,305 @@
+#include "server.hpp"
+#include "driver.hpp"
+#include "thread_pool.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <future>
+#include <list>
+#include <mutex>
+#include <poll.h>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Larger requests close the connection
+const uint32_t MAX_REQUEST = 1u << 30;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) { stop_requested = 1; }
+
+// Buffers a pool worker reuses from one request to the next
+struct Scratch {
+    std::vector<std::string> args;
+    std::ostringstream out;
+    std::ostringstream err;
+};
+
+static thread_local Scratch scratch;
+
+// Reads exactly size bytes, false at the end of the stream or on errors
+static bool read_exact(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = read(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// A client that went away must not raise SIGPIPE in the server
+static bool write_exact(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static uint32_t load_u32(const char *bytes) {
+    const unsigned char *b = reinterpret_cast<const unsigned char *>(bytes);
+    return b[0] | b[1] << 8 | b[2] << 16 | uint32_t(b[3]) << 24;
+}
+
+static void append_u32(std::string &out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out += char(value >> (8 * i));
+    }
+}
+
+// Arguments end at an empty one, the rest of the request is source text
+static std::string_view split_request(std::string_view request,
+                                      std::vector<std::string> &args) {
+    args.clear();
+    for (;;) {
+        size_t end = request.find('\0');
+        if (end == std::string_view::npos) {
+            throw std::runtime_error(
+                "Malformed request: arguments are not terminated");
+        }
+        if (end == 0) {
+            return request.substr(1);
+        }
+        args.emplace_back(request.substr(0, end));
+        request.remove_prefix(end + 1);
+    }
+}
+
+static int handle_request(std::string_view request, const Options &defaults,
+                          Scratch &s) {
+    std::string_view source = split_request(request, s.args);
+    Options options = defaults;
+    options.capture_output = true;
+    std::string input;
+    for (size_t i = 0; i < s.args.size(); i++) {
+        const std::string &arg = s.args[i];
+        if (apply_unit_flag(arg, options)) {
+            continue;
+        }
+        if (arg == "-o" && i + 1 < s.args.size()) {
+            options.output = s.args[++i];
+        } else if (arg.empty() || arg[0] == '-' || !input.empty()) {
+            throw std::runtime_error("Unsupported argument: " + arg);
+        } else {
+            input = arg;
+        }
+    }
+    if (options.jit) {
+        throw std::runtime_error("--jit is not available in the server");
+    }
+
+    if (input.empty()) {
+        return compile_source(source, options, s.out, s.err);
+    }
+    return compile_unit(input, options, s.out, s.err);
+}
+
+// Compiles one request on a pool worker and frames its response
+static std::string respond(std::string_view request, const Options &defaults) {
+    Scratch &s = scratch;
+    s.out.str(std::string());
+    s.err.str(std::string());
+    int status;
+    try {
+        status = handle_request(request, defaults, s);
+    } catch (std::exception &e) {
+        s.out << e.what() << std::endl;
+        status = EXIT_FAILURE;
+    }
+
+    std::string out = s.out.str();
+    std::string err = s.err.str();
+    std::string response;
+    append_u32(response, 8 + out.size() + err.size());
+    append_u32(response, uint32_t(status));
+    append_u32(response, out.size());
+    response += out;
+    response += err;
+    return response;
+}
+
+// Reads the requests of one connection on its own thread. Only compiling
+// takes a pool worker, so idle connections do not hold any.
+static void serve_connection(int fd, const Options &defaults,
+                             ThreadPool &pool) {
+    std::string request;
+    char header[4];
+    while (read_exact(fd, header, 4)) {
+        uint32_t size = load_u32(header);
+        if (size > MAX_REQUEST) {
+            return;
+        }
+        request.resize(size);
+        if (!read_exact(fd, &request[0], size)) {
+            return;
+        }
+
+        std::promise<std::string> promise;
+        std::future<std::string> response = promise.get_future();
+        pool.submit([&] {
+            try {
+                promise.set_value(respond(request, defaults));
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+        });
+        std::string bytes;
+        try {
+            bytes = response.get();
+        } catch (std::exception &) {
+            return;
+        }
+        if (!write_exact(fd, bytes.data(), bytes.size())) {
+            return;
+        }
+    }
+}
+
+int serve(const std::string &path, const Options &defaults, unsigned threads) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    sockaddr *name = reinterpret_cast<sockaddr *>(&address);
+
+    // A socket file nobody answers on is left over from an earlier server
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool listening = probe >= 0 && connect(probe, name, sizeof(address)) == 0;
+    if (probe >= 0) {
+        close(probe);
+    }
+    if (listening) {
+        throw std::runtime_error("A server is already listening on " + path);
+    }
+    unlink(path.c_str());
+
+    // Non-blocking, a client may be gone again by the time it is accepted
+    int listener =
+        socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listener < 0) {
+        throw std::runtime_error(std::string("Cannot create socket: ") +
+                                 strerror(errno));
+    }
+    if (bind(listener, name, sizeof(address)) < 0 ||
+        listen(listener, SOMAXCONN) < 0) {
+        int error = errno;
+        close(listener);
+        throw std::runtime_error("Cannot listen on " + path + ": " +
+                                 strerror(error));
+    }
+
+    // The stop signals stay blocked but while ppoll() waits for a client,
+    // so one that comes just before the wait is not lost: ppoll() returns
+    // at once. Threads start with them blocked too.
+    struct sigaction action = {};
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigset_t original;
+    pthread_sigmask(SIG_BLOCK, &signals, &original);
+    sigset_t waiting = original;
+    sigdelset(&waiting, SIGINT);
+    sigdelset(&waiting, SIGTERM);
+
+    struct Connection {
+        std::thread thread;
+        bool done = false;
+    };
+    std::mutex mutex; // guards clients and connections
+    std::set<int> clients;
+    std::list<Connection> connections;
+    {
+        ThreadPool pool(threads);
+
+        while (!stop_requested) {
+            pollfd ready = {listener, POLLIN, 0};
+            if (ppoll(&ready, 1, nullptr, &waiting) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK ||
+                    errno == ECONNABORTED || errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            // Threads of closed connections are joined as new ones come
+            for (auto i = connections.begin(); i != connections.end();) {
+                if (i->done) {
+                    i->thread.join();
+                    i = connections.erase(i);
+                } else {
+                    ++i;
+                }
+            }
+            clients.insert(client);
+            Connection &connection = connections.emplace_back();
+            bool *done = &connection.done;
+            connection.thread = std::thread([&, client, done] {
+                serve_connection(client, defaults, pool);
+                std::lock_guard<std::mutex> lock(mutex);
+                clients.erase(client);
+                close(client);
+                *done = true;
+            });
+        }
+
+        // Requests being compiled are answered, idle connections see the
+        // end of their stream
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int client : clients) {
+                shutdown(client, SHUT_RD);
+            }
+        }
+        for (Connection &connection : connections) {
+            connection.thread.join();
+        }
+    }
+    close(listener);
+    unlink(path.c_str());
+    pthread_sigmask(SIG_SETMASK, &original, nullptr);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+
+struct Options;
+
+// Compiles requests sent to a Unix socket at path until SIGINT or SIGTERM,
+// with up to threads connections served at once. Each connection carries
+// any number of requests, answered in order.
+//
+// Every message is a frame: a little-endian uint32 byte count, then the
+// bytes. A request holds command line arguments, each ended by a NUL byte,
+// then an empty argument. Unless the arguments name a source file, the
+// rest of the request is the source text. The response holds the exit
+// status as a little-endian int32, the length of out as a uint32, then
+// out and err: what the command line compiler would print on stdout,
+// assembly included, and on stderr. Objects and executables are returned
+// in out too, unless -o names a file for them.
+//
+// Requests start from the options given on the server's command line.
+// Paths are resolved by the server, and --jit is refused since a crashing
+// program would take the server down.
+int serve(const std::string &path, const Options &defaults, unsigned threads);
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// SHA-256 (FIPS 180-4), fed incrementally
+class Sha256 {
+  public:
+    Sha256();
+    void update(std::string_view bytes);
+    // Lowercase hex of the digest; the object must not be updated after
+    std::string hex();
+
+  private:
+    uint32_t state[8];
+    uint8_t block[64];
+    size_t used = 0;     // bytes in block
+    uint64_t length = 0; // total bytes hashed
+
+    void compress();
+};
@@ -0,0 +1,63 @@
+#include "source_buffer.hpp"
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceBuffer::SourceBuffer(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file: " + filename);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw std::runtime_error("Could not stat file: " + filename);
+    }
+
+    // mmap rejects zero length mappings, an empty file is just an empty view
+    if (st.st_size > 0) {
+        void *mapping =
+            mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Could not map file: " + filename);
+        }
+        // The lexer walks the input front to back exactly once
+        madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(mapping);
+        size = st.st_size;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+SourceBuffer::~SourceBuffer() { release(); }
+
+SourceBuffer::SourceBuffer(SourceBuffer &&other) noexcept
+    : data(other.data), size(other.size) {
+    other.data = nullptr;
+    other.size = 0;
+}
+
+SourceBuffer &SourceBuffer::operator=(SourceBuffer &&other) noexcept {
+    if (this != &other) {
+        release();
+        data = other.data;
+        size = other.size;
+        other.data = nullptr;
+        other.size = 0;
+    }
+    return *this;
+}
+
+void SourceBuffer::release() {
+    if (data) {
+        munmap(const_cast<char *>(data), size);
+        data = nullptr;
+        size = 0;
+    }
+}
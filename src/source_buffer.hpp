@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a source file. The file is memory mapped so that the
+// lexer and the tokens it produces can point straight into the page cache
+// instead of owning copies of the input.
+class SourceBuffer {
+  public:
+    SourceBuffer() = default;
+    explicit SourceBuffer(const std::string &filename);
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+    SourceBuffer(SourceBuffer &&other) noexcept;
+    SourceBuffer &operator=(SourceBuffer &&other) noexcept;
+
+    std::string_view view() const { return std::string_view(data, size); }
+
+  private:
+    const char *data = nullptr;
+    size_t size = 0;
+
+    void release();
+};
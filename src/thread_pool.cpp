@@ -0,0 +1,53 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(unsigned threads) {
+    workers.reserve(threads);
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    available.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return tasks.empty() && running == 0; });
+}
+
+void ThreadPool::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        available.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty()) {
+            return; // stopping with nothing left to run
+        }
+
+        std::function<void()> task = std::move(tasks.front());
+        tasks.pop_front();
+        running++;
+        lock.unlock();
+        task();
+        lock.lock();
+        running--;
+        if (tasks.empty() && running == 0) {
+            finished.notify_all();
+        }
+    }
+}
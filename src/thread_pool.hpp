@@ -0,0 +1,33 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads taking tasks from one FIFO queue
+class ThreadPool {
+  public:
+    explicit ThreadPool(unsigned threads);
+    // Runs the tasks still queued, then joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+    // Blocks until every submitted task has finished
+    void wait();
+
+  private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable available; // a task was queued or stopping
+    std::condition_variable finished;  // the pool went idle
+    unsigned running = 0;
+    bool stopping = false;
+
+    void work();
+};
@@ -0,0 +1,46 @@
+#include "token_source.hpp"
+#include <iostream>
+#include <stdexcept>
+
+LexerSource::LexerSource(std::string_view input, Interner &interner)
+    : LexerSource(input, interner, std::cout) {}
+
+LexerSource::LexerSource(std::string_view input, Interner &interner,
+                         std::ostream &errors,
+                         std::vector<LexerError> *error_list) {
+    init_lexer(&lexer, input, interner, errors);
+    lexer.error_list = error_list;
+}
+
+Token LexerSource::pull() {
+    if (!next_token(&lexer)) {
+        Token end = {};
+        end.type = END_OF_FILE;
+        end.text = lexer.input.substr(lexer.input.size());
+        return end;
+    }
+    return lexer.token;
+}
+
+Token StreamSource::pull() {
+    if (index == end) {
+        Token end = {};
+        end.type = END_OF_FILE;
+        end.text = tokens.source.substr(tokens.source.size());
+        return end;
+    }
+    return tokens.at(index++);
+}
+
+const Token &TokenCursor::fill(unsigned k) {
+    if (k >= MAX_LOOKAHEAD) {
+        throw std::logic_error("TokenCursor lookahead exceeds capacity");
+    }
+
+    // The slot behind head holds previous() and is never refilled here
+    while (count <= k) {
+        ring[(head + count) % CAPACITY] = source.pull();
+        count++;
+    }
+    return ring[(head + k) % CAPACITY];
+}
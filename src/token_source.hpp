@@ -0,0 +1,88 @@
+#pragma once
+#include "lexer.hpp"
+#include "token_stream.hpp"
+
+// Pull interface over the tokens of one source. Once the input is exhausted
+// every call returns an END_OF_FILE token.
+class TokenSource {
+  public:
+    virtual ~TokenSource(){};
+    virtual Token pull() = 0;
+};
+
+// Lexes on demand, one token per pull. Lexer errors are reported to
+// errors, stdout by default.
+class LexerSource : public TokenSource {
+  public:
+    LexerSource(std::string_view input, Interner &interner);
+    LexerSource(std::string_view input, Interner &interner,
+                std::ostream &errors,
+                std::vector<LexerError> *error_list = nullptr);
+    Token pull() override;
+
+    // Whether the input ended after lexer errors, the error pull() throws
+    // then
+    bool failed() const { return !lexer.has_token && lexer.encountered_error; }
+
+  private:
+    Lexer lexer;
+};
+
+// Replays an already lexed TokenStream, or the tokens [first, end) of it
+class StreamSource : public TokenSource {
+  public:
+    explicit StreamSource(const TokenStream &tokens)
+        : tokens(tokens), end(tokens.size()) {}
+    StreamSource(const TokenStream &tokens, size_t first, size_t end)
+        : tokens(tokens), index(first), end(end) {}
+    Token pull() override;
+
+  private:
+    const TokenStream &tokens;
+    size_t index = 0;
+    size_t end;
+};
+
+// Lookahead window over a TokenSource. Only the last consumed token and the
+// next few upcoming ones are held, so token memory does not grow with the
+// size of the input.
+class TokenCursor {
+  public:
+    static const unsigned CAPACITY = 4; // must be a power of two
+    static const unsigned MAX_LOOKAHEAD = CAPACITY - 1;
+
+    // first is the index of the source's first token in the whole
+    // sequence, when the source starts in the middle of it
+    explicit TokenCursor(TokenSource &source, uint32_t first = 0)
+        : source(source), consumed(first) {}
+
+    // k-th upcoming token, peek(0) is the token next() will return
+    const Token &peek(unsigned k = 0) {
+        if (k < count) {
+            return ring[(head + k) % CAPACITY];
+        }
+        return fill(k);
+    }
+
+    Token next() {
+        Token token = peek(0);
+        head = (head + 1) % CAPACITY;
+        count--;
+        consumed++;
+        return token;
+    }
+    const Token &previous() const { return ring[(head - 1) % CAPACITY]; }
+    // Index of previous() in the token sequence
+    uint32_t previous_index() const { return consumed - 1; }
+    // Index of peek(0) in the token sequence
+    uint32_t index() const { return consumed; }
+
+  private:
+    TokenSource &source;
+    Token ring[CAPACITY] = {};
+    unsigned head = 0;  // slot of the next upcoming token
+    unsigned count = 0; // number of upcoming tokens already pulled
+    uint32_t consumed = 0;
+
+    const Token &fill(unsigned k);
+};
@@ -0,0 +1,114 @@
+#include "token_stream.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cstring>
+
+std::string_view token_type_text(TokenType type) {
+    switch (type) {
+    case LEFT_PAREN:
+        return "(";
+    case RIGHT_PAREN:
+        return ")";
+    case LEFT_BRACE:
+        return "{";
+    case RIGHT_BRACE:
+        return "}";
+    case COMMA:
+        return ",";
+    case DOT:
+        return ".";
+    case MINUS:
+        return "-";
+    case PLUS:
+        return "+";
+    case SEMICOLON:
+        return ";";
+    case STAR:
+        return "*";
+    case SLASH:
+        return "/";
+    case BANG:
+        return "!";
+    case EQUAL:
+        return "=";
+    case BANG_EQUAL:
+        return "!=";
+    case EQUAL_EQUAL:
+        return "==";
+    case GREATER:
+        return ">";
+    case GREATER_EQUAL:
+        return ">=";
+    case LESS:
+        return "<";
+    case LESS_EQUAL:
+        return "<=";
+    default:
+        return "";
+    }
+}
+
+uint32_t Interner::intern(std::string_view text) {
+    auto found = ids.find(text);
+    if (found != ids.end()) {
+        return found->second;
+    }
+
+    char *copy = static_cast<char *>(storage.allocate(text.size(), 1));
+    memcpy(copy, text.data(), text.size());
+    std::string_view owned(copy, text.size());
+    uint32_t id = texts.size();
+    texts.push_back(owned);
+    ids.emplace(owned, id);
+    return id;
+}
+
+Token TokenStream::at(size_t i) const {
+    Token token;
+    token.type = types[i];
+    token.id = ids[i];
+    token.text = source.substr(offsets[i], lengths[i]);
+    return token;
+}
+
+void TokenStream::push(TokenType type, uint64_t offset, uint32_t length,
+                       uint32_t id) {
+    types.push_back(type);
+    offsets.push_back(offset);
+    lengths.push_back(length);
+    ids.push_back(id);
+}
+
+void TokenStream::splice(size_t first, size_t count,
+                         const TokenStream &replacement, int64_t shift) {
+    ::splice(types, first, count, replacement.types.begin(),
+             replacement.types.end());
+    ::splice(offsets, first, count, replacement.offsets.begin(),
+             replacement.offsets.end());
+    ::splice(lengths, first, count, replacement.lengths.begin(),
+             replacement.lengths.end());
+    ::splice(ids, first, count, replacement.ids.begin(),
+             replacement.ids.end());
+
+    for (size_t i = first + replacement.size(); i < offsets.size(); i++) {
+        offsets[i] += shift;
+    }
+    line_starts.clear();
+}
+
+uint32_t TokenStream::line(size_t i) const {
+    if (line_starts.empty()) {
+        line_starts.push_back(0);
+        const char *begin = source.data();
+        const char *end = begin + source.size();
+        const char *p = begin;
+        while ((p = static_cast<const char *>(memchr(p, '\n', end - p)))) {
+            p++;
+            line_starts.push_back(p - begin);
+        }
+    }
+
+    auto next_line =
+        std::upper_bound(line_starts.begin(), line_starts.end(), offsets[i]);
+    return next_line - line_starts.begin();
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include "arena.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Stored as a single byte per token in TokenStream
+enum TokenType : uint8_t {
+    LEFT_PAREN,
+    RIGHT_PAREN,
+    LEFT_BRACE,
+    RIGHT_BRACE,
+    COMMA,
+    DOT,
+    MINUS,
+    PLUS,
+    SEMICOLON,
+    STAR,
+    SLASH,
+    BANG,
+    EQUAL,
+    BANG_EQUAL,
+    EQUAL_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    STRING,
+    NUMBER,
+    IDENTIFIER,
+    TRUE,
+    FALSE,
+    AUTO,
+    BREAK,
+    CHAR,
+    CONST,
+    CONTINUE,
+    DEFAULT,
+    DO,
+    DOUBLE,
+    ELSE,
+    ENUM,
+    EXTERN,
+    FLOAT,
+    FOR,
+    GOTO,
+    IF,
+    INT,
+    LONG,
+    _NULL,
+    REGISTER,
+    RETURN,
+    SHORT,
+    SIGNED,
+    SIZEOF,
+    STATIC,
+    STRUCT,
+    SWITCH,
+    TYPEDEF,
+    UNION,
+    UNSIGNED,
+    VOID,
+    VOLATILE,
+    WHILE,
+    END_OF_FILE,
+};
+
+// Spelling of punctuation and operator tokens, empty for everything else
+std::string_view token_type_text(TokenType type);
+
+// A single token as handed to the parser. The text points into the source
+// buffer, the id is only set for IDENTIFIER and STRING tokens.
+struct Token {
+    TokenType type;
+    uint32_t id;
+    std::string_view text;
+};
+
+// Maps identifier and string literal text to dense ids. Ids start at 1 so
+// that 0 can mean "not interned". The table owns a copy of every distinct
+// string in an arena, so ids stay valid independently of the source they
+// came from.
+class Interner {
+  public:
+    uint32_t intern(std::string_view text);
+    std::string_view text(uint32_t id) const { return texts.at(id); }
+    size_t size() const { return texts.size() - 1; }
+
+  private:
+    Arena storage;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<std::string_view> texts = {std::string_view()};
+};
+
+// Tokens of a whole source file stored as parallel arrays. Line numbers are
+// not stored per token, they are computed on demand from the offset.
+class TokenStream {
+  public:
+    std::string_view source;
+    Interner *interner = nullptr;
+
+    std::vector<TokenType> types;
+    std::vector<uint64_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<uint32_t> ids;
+
+    size_t size() const { return types.size(); }
+    Token at(size_t i) const;
+    void push(TokenType type, uint64_t offset, uint32_t length, uint32_t id);
+
+    // Replaces tokens [first, first + count) with the tokens of
+    // replacement and moves the tokens after them by shift bytes
+    void splice(size_t first, size_t count, const TokenStream &replacement,
+                int64_t shift);
+
+    // 1-based line of token i. The first call indexes every line start.
+    uint32_t line(size_t i) const;
+
+  private:
+    mutable std::vector<uint64_t> line_starts;
+};
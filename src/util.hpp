@@ -7,3 +7,21 @@
     do {                                                                       \
     } while (0)
 #endif
+
+#include <algorithm>
+#include <vector>
+
+// Replaces items [first, first + count) of items with [begin, end), moving
+// the items after them only once
+template <typename T, typename It>
+void splice(std::vector<T> &items, size_t first, size_t count, It begin,
+            It end) {
+    size_t size = end - begin;
+    size_t common = std::min(size, count);
+    std::copy(begin, begin + common, items.begin() + first);
+    if (size > count) {
+        items.insert(items.begin() + first + count, begin + common, end);
+    } else {
+        items.erase(items.begin() + first + size, items.begin() + first + count);
+    }
+}
@@ -1,16 +1,29 @@
 #pragma once
-#include <string>
+#include "ast.hpp"
 
-class Binary;
-class Grouping;
-class Literal;
-class Unary;
-
-class Visitor {
+// Tag-switch dispatch over the node table. Each pass derives from
+// Visitor<Pass, Result> and picks its own Result type; the visit_* calls
+// are resolved at compile time, so walking the tree makes no virtual calls.
+template <typename Derived, typename Result> class Visitor {
   public:
-    virtual ~Visitor(){};
-    virtual std::string visit_binary_expr(Binary *) = 0;
-    virtual std::string visit_grouping_expr(Grouping *) = 0;
-    virtual std::string visit_literal_expr(Literal *) = 0;
-    virtual std::string visit_unary_expr(Unary *) = 0;
-};
\ No newline at end of file
+    Result visit(NodeIndex index) {
+        Derived *self = static_cast<Derived *>(this);
+        switch (ast->at(index).tag) {
+        case NODE_BINARY:
+            return self->visit_binary_expr(index);
+        case NODE_GROUPING:
+            return self->visit_grouping_expr(index);
+        case NODE_UNARY:
+            return self->visit_unary_expr(index);
+        case NODE_NUMBER:
+        case NODE_STRING:
+        case NODE_BOOLEAN:
+        case NODE_NIL:
+            return self->visit_literal_expr(index);
+        }
+        return Result();
+    }
+
+  protected:
+    const Ast *ast = nullptr;
+};
@@ -0,0 +1,222 @@
+#include "bytecode.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+const char *bytecode_op_text(BytecodeOp op) {
+    static const char *names[] = {
+        "loadk", "loadk", "add",  "sub",  "mul",  "div",  "eq",
+        "ne",    "lt",    "le",   "gt",   "ge",   "neg",  "not",
+        "addk",  "subk",  "mulk", "divk", "eqk",  "nek",  "ltk",
+        "lek",   "gtk",   "gek",  "ret"};
+    static_assert(sizeof(names) / sizeof(*names) == OP_COUNT,
+                  "every opcode needs a name");
+    return names[op];
+}
+
+// Comparison that holds after swapping the operands
+static BytecodeOp mirror(BytecodeOp op) {
+    switch (op) {
+    case OP_LT:
+        return OP_GT;
+    case OP_LE:
+        return OP_GE;
+    case OP_GT:
+        return OP_LT;
+    case OP_GE:
+        return OP_LE;
+    default:
+        return op;
+    }
+}
+
+Bytecode BytecodeCompiler::compile(const Ast &ast) {
+    this->ast = &ast;
+    label_nodes();
+
+    program = Bytecode();
+    pool.clear();
+    top = 0;
+    uint8_t result = visit(ast.root);
+    emit(OP_RET, 0, result);
+    return std::move(program);
+}
+
+// Same labels as IrBuilder: literals may end up inside a K instruction
+// and are counted as free. Children are always added to the node table
+// before their parent.
+void BytecodeCompiler::label_nodes() {
+    need.assign(ast->nodes.size(), 0);
+    for (NodeIndex i = 0; i < ast->nodes.size(); i++) {
+        const Node &node = ast->at(i);
+        switch (node.tag) {
+        case NODE_BINARY: {
+            uint32_t left = need[node.lhs];
+            uint32_t right = need[node.rhs];
+            need[i] = std::max(left == right ? left + 1 : std::max(left, right),
+                               1u);
+            break;
+        }
+        case NODE_GROUPING:
+            need[i] = need[node.lhs];
+            break;
+        case NODE_UNARY:
+            need[i] = std::max(need[node.lhs], 1u);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Value of a literal, looking through parentheses
+bool BytecodeCompiler::constant_value(NodeIndex index, int64_t &value) const {
+    while (ast->at(index).tag == NODE_GROUPING) {
+        index = ast->at(index).lhs;
+    }
+    const Node &node = ast->at(index);
+    switch (node.tag) {
+    case NODE_NUMBER:
+        value = ast->number(index);
+        return true;
+    case NODE_BOOLEAN:
+        value = node.lhs;
+        return true;
+    case NODE_NIL:
+        value = 0;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Pool index of a constant, each value is stored once
+uint32_t BytecodeCompiler::constant(int64_t value) {
+    auto [it, added] = pool.try_emplace(value, program.constants.size());
+    if (added) {
+        program.constants.push_back(value);
+    }
+    return it->second;
+}
+
+uint8_t BytecodeCompiler::allocate() {
+    if (top > UINT8_MAX) {
+        throw std::runtime_error(
+            "Bytecode: expression needs more than 256 registers");
+    }
+    program.registers = std::max(program.registers, top + 1);
+    return top++;
+}
+
+void BytecodeCompiler::emit(BytecodeOp op, uint8_t dst, uint8_t a,
+                            uint8_t b) {
+    program.code.push_back({op, dst, a, b});
+}
+
+uint8_t BytecodeCompiler::visit_binary_expr(NodeIndex index) {
+    const Node &node = ast->at(index);
+
+    BytecodeOp op;
+    bool commutative = true; // or mirrored for comparisons
+    switch (node.oprt) {
+    case PLUS:
+        op = OP_ADD;
+        break;
+    case MINUS:
+        op = OP_SUB;
+        commutative = false;
+        break;
+    case STAR:
+        op = OP_MUL;
+        break;
+    case SLASH:
+        op = OP_DIV;
+        commutative = false;
+        break;
+    case EQUAL_EQUAL:
+        op = OP_EQ;
+        break;
+    case BANG_EQUAL:
+        op = OP_NE;
+        break;
+    case LESS:
+        op = OP_LT;
+        break;
+    case LESS_EQUAL:
+        op = OP_LE;
+        break;
+    case GREATER:
+        op = OP_GT;
+        break;
+    case GREATER_EQUAL:
+        op = OP_GE;
+        break;
+    default:
+        throw std::runtime_error("Bytecode: unsupported operator " +
+                                 std::string(token_type_text(node.oprt)));
+    }
+
+    NodeIndex left = node.lhs;
+    NodeIndex right = node.rhs;
+    int64_t value;
+    if (commutative && !constant_value(right, value) &&
+        constant_value(left, value)) {
+        std::swap(left, right);
+        op = mirror(op);
+    }
+
+    uint32_t base = top;
+    if (constant_value(right, value)) {
+        uint32_t k = constant(value);
+        if (k <= UINT8_MAX) {
+            uint8_t a = visit(left);
+            top = base;
+            emit(BytecodeOp(op - OP_ADD + OP_ADDK), allocate(), a, k);
+            return base;
+        }
+    }
+
+    uint8_t a, b;
+    if (need[right] > need[left]) {
+        b = visit(right);
+        a = visit(left);
+    } else {
+        a = visit(left);
+        b = visit(right);
+    }
+    top = base;
+    emit(op, allocate(), a, b);
+    return base;
+}
+
+uint8_t BytecodeCompiler::visit_grouping_expr(NodeIndex index) {
+    return visit(ast->at(index).lhs);
+}
+
+uint8_t BytecodeCompiler::visit_literal_expr(NodeIndex index) {
+    int64_t value;
+    if (!constant_value(index, value)) {
+        throw std::runtime_error("Bytecode: string literals are not supported");
+    }
+
+    uint32_t k = constant(value);
+    uint8_t dst = allocate();
+    if (k <= UINT16_MAX) {
+        emit(OP_LOADK, dst, k & 0xff, k >> 8);
+    } else {
+        emit(OP_LOADK_WIDE, dst);
+        emit(BytecodeOp(k & 0xff), k >> 8, k >> 16, k >> 24);
+    }
+    return dst;
+}
+
+uint8_t BytecodeCompiler::visit_unary_expr(NodeIndex index) {
+    const Node &node = ast->at(index);
+    uint32_t base = top;
+    uint8_t operand = visit(node.lhs);
+    top = base;
+
+    // false, nil and 0 are falsy
+    emit(node.oprt == BANG ? OP_NOT : OP_NEG, allocate(), operand);
+    return base;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "../visitor.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+enum BytecodeOp : uint8_t {
+    OP_LOADK,      // dst = constants[a | b << 8]
+    OP_LOADK_WIDE, // dst = constants[next word], pools past 64K entries
+    OP_ADD,        // dst = a + b
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_EQ, // dst = (a == b) ? 1 : 0
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_NEG, // dst = -a
+    OP_NOT, // dst = (a == 0) ? 1 : 0
+
+    // Superinstructions: a load of constant b fused into the instruction
+    // that uses it as the right operand
+    OP_ADDK,
+    OP_SUBK,
+    OP_MULK,
+    OP_DIVK,
+    OP_EQK,
+    OP_NEK,
+    OP_LTK,
+    OP_LEK,
+    OP_GTK,
+    OP_GEK,
+
+    OP_RET, // program result a
+
+    OP_COUNT
+};
+
+// One 32-bit instruction word. dst, a and b name registers, or for the K
+// forms b names one of the first 256 constants.
+struct BytecodeInstr {
+    BytecodeOp op;
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+};
+
+static_assert(sizeof(BytecodeInstr) == 4, "Bytecode should stay one word");
+
+struct Bytecode {
+    std::vector<BytecodeInstr> code;
+    std::vector<int64_t> constants;
+    uint32_t registers = 0; // size of the register file the code uses
+};
+
+const char *bytecode_op_text(BytecodeOp op);
+
+// Index of the constant pool entry of OP_LOADK_WIDE, kept in the word that
+// follows it
+inline uint32_t wide_index(const BytecodeInstr &word) {
+    return word.op | word.dst << 8 | word.a << 16 | uint32_t(word.b) << 24;
+}
+
+// Compiles the AST of a program into register bytecode for run_bytecode().
+// Registers are handed out like a stack, each subtree leaving its value
+// in the first register that was free when it started, and subtrees are
+// visited in Sethi-Ullman order so the register file stays small.
+class BytecodeCompiler : public Visitor<BytecodeCompiler, uint8_t> {
+  public:
+    Bytecode compile(const Ast &ast);
+
+    uint8_t visit_binary_expr(NodeIndex index);
+    uint8_t visit_grouping_expr(NodeIndex index);
+    uint8_t visit_literal_expr(NodeIndex index);
+    uint8_t visit_unary_expr(NodeIndex index);
+
+  private:
+    Bytecode program;
+    std::vector<uint32_t> need; // registers each subtree needs
+    std::unordered_map<int64_t, uint32_t> pool; // constant -> pool index
+    uint32_t top = 0;                           // first free register
+
+    void label_nodes();
+    bool constant_value(NodeIndex index, int64_t &value) const;
+    uint32_t constant(int64_t value);
+    uint8_t allocate();
+    void emit(BytecodeOp op, uint8_t dst, uint8_t a = 0, uint8_t b = 0);
+};
@@ -0,0 +1,132 @@
+#include "vm.hpp"
+#include <stdexcept>
+
+// Two's complement arithmetic without signed overflow
+static int64_t wrap_add(int64_t a, int64_t b) {
+    return int64_t(uint64_t(a) + uint64_t(b));
+}
+
+static int64_t wrap_sub(int64_t a, int64_t b) {
+    return int64_t(uint64_t(a) - uint64_t(b));
+}
+
+static int64_t wrap_mul(int64_t a, int64_t b) {
+    return int64_t(uint64_t(a) * uint64_t(b));
+}
+
+static int64_t divide(int64_t a, int64_t b) {
+    if (b == 0) {
+        throw std::runtime_error("Runtime error: division by zero");
+    }
+    if (b == -1) {
+        return wrap_sub(0, a); // INT64_MIN / -1 overflows
+    }
+    return a / b;
+}
+
+// Threaded dispatch: every handler jumps straight to the handler of the
+// next instruction through the label table, so each opcode gets its own
+// indirect branch instead of sharing the one at the top of a switch.
+int64_t run_bytecode(const Bytecode &program) {
+    static const void *const labels[] = {
+        &&op_loadk, &&op_loadk_wide, &&op_add, &&op_sub,  &&op_mul,
+        &&op_div,   &&op_eq,         &&op_ne,  &&op_lt,   &&op_le,
+        &&op_gt,    &&op_ge,         &&op_neg, &&op_not,  &&op_addk,
+        &&op_subk,  &&op_mulk,       &&op_divk, &&op_eqk, &&op_nek,
+        &&op_ltk,   &&op_lek,        &&op_gtk, &&op_gek,  &&op_ret};
+    static_assert(sizeof(labels) / sizeof(*labels) == OP_COUNT,
+                  "every opcode needs a handler");
+
+    std::vector<int64_t> frame(program.registers);
+    int64_t *r = frame.data();
+    const int64_t *k = program.constants.data();
+    const BytecodeInstr *pc = program.code.data();
+
+#define DISPATCH() goto *labels[pc->op]
+#define NEXT()                                                                 \
+    do {                                                                       \
+        pc++;                                                                  \
+        DISPATCH();                                                            \
+    } while (0)
+
+    DISPATCH();
+
+op_loadk:
+    r[pc->dst] = k[pc->a | pc->b << 8];
+    NEXT();
+op_loadk_wide:
+    r[pc->dst] = k[wide_index(pc[1])];
+    pc++;
+    NEXT();
+op_add:
+    r[pc->dst] = wrap_add(r[pc->a], r[pc->b]);
+    NEXT();
+op_sub:
+    r[pc->dst] = wrap_sub(r[pc->a], r[pc->b]);
+    NEXT();
+op_mul:
+    r[pc->dst] = wrap_mul(r[pc->a], r[pc->b]);
+    NEXT();
+op_div:
+    r[pc->dst] = divide(r[pc->a], r[pc->b]);
+    NEXT();
+op_eq:
+    r[pc->dst] = r[pc->a] == r[pc->b];
+    NEXT();
+op_ne:
+    r[pc->dst] = r[pc->a] != r[pc->b];
+    NEXT();
+op_lt:
+    r[pc->dst] = r[pc->a] < r[pc->b];
+    NEXT();
+op_le:
+    r[pc->dst] = r[pc->a] <= r[pc->b];
+    NEXT();
+op_gt:
+    r[pc->dst] = r[pc->a] > r[pc->b];
+    NEXT();
+op_ge:
+    r[pc->dst] = r[pc->a] >= r[pc->b];
+    NEXT();
+op_neg:
+    r[pc->dst] = wrap_sub(0, r[pc->a]);
+    NEXT();
+op_not:
+    r[pc->dst] = r[pc->a] == 0;
+    NEXT();
+op_addk:
+    r[pc->dst] = wrap_add(r[pc->a], k[pc->b]);
+    NEXT();
+op_subk:
+    r[pc->dst] = wrap_sub(r[pc->a], k[pc->b]);
+    NEXT();
+op_mulk:
+    r[pc->dst] = wrap_mul(r[pc->a], k[pc->b]);
+    NEXT();
+op_divk:
+    r[pc->dst] = divide(r[pc->a], k[pc->b]);
+    NEXT();
+op_eqk:
+    r[pc->dst] = r[pc->a] == k[pc->b];
+    NEXT();
+op_nek:
+    r[pc->dst] = r[pc->a] != k[pc->b];
+    NEXT();
+op_ltk:
+    r[pc->dst] = r[pc->a] < k[pc->b];
+    NEXT();
+op_lek:
+    r[pc->dst] = r[pc->a] <= k[pc->b];
+    NEXT();
+op_gtk:
+    r[pc->dst] = r[pc->a] > k[pc->b];
+    NEXT();
+op_gek:
+    r[pc->dst] = r[pc->a] >= k[pc->b];
+    NEXT();
+op_ret:
+    return r[pc->a];
+
+#undef NEXT
+#undef DISPATCH
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "bytecode.hpp"
+
+// Executes a compiled program and returns its result. Arithmetic wraps
+// around like the native backends, division by zero throws.
+int64_t run_bytecode(const Bytecode &program);
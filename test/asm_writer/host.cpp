@@ -0,0 +1,44 @@
+// Writes the lines of a script through an AsmWriter with small buffers,
+// for the AsmWriter tests. Each script line names the section, text or
+// data, followed by the line written to it. Prints what the writer
+// produced.
+//
+//   make test/asm_writer/host.out
+//   ./test/asm_writer/host.out script.ko
+
+#include "asm_writer.hpp"
+#include <fstream>
+#include <iostream>
+#include <string>
+
+int main(int argc, char const *argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " script.ko" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ifstream script(argv[1]);
+    if (!script) {
+        std::cout << "Cannot read " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string output;
+    AsmWriter writer(&output, 16);
+    writer.set_directive(AsmWriter::TEXT, ".text\n");
+    writer.set_directive(AsmWriter::DATA, ".data\n");
+    std::string line;
+    while (std::getline(script, line)) {
+        size_t space = line.find(' ');
+        std::string section = line.substr(0, space);
+        writer.section(section == "data" ? AsmWriter::DATA : AsmWriter::TEXT);
+        // Written in pieces, the way code generators write a line
+        std::string rest = line.substr(space + 1);
+        for (size_t i = 0; i < rest.size(); i += 5) {
+            writer << std::string_view(rest).substr(i, 5);
+        }
+        writer << '\n';
+    }
+    writer.flush();
+    std::cout << output;
+    return EXIT_SUCCESS;
+}
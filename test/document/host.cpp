@@ -0,0 +1,84 @@
+// Replays edits on a Document the way an editor keeps one up to date, for
+// the document tests. Each line of the edits file holds an offset, the
+// number of bytes removed there and the escaped text inserted. Prints what
+// every edit cost and the tree or error after it, and fails as soon as the
+// document differs from a full parse of its text.
+//
+//   make test/document/host.out
+//   ./test/document/host.out file.ko file.edits
+
+#include "document.hpp"
+#include "printers/ast_printer.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Text of an edit with \n, \t and \\ escapes resolved
+static std::string unescape(const std::string &text) {
+    std::string out;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] != '\\' || i + 1 == text.size()) {
+            out += text[i];
+            continue;
+        }
+        char c = text[++i];
+        out += c == 'n' ? '\n' : c == 't' ? '\t' : c;
+    }
+    return out;
+}
+
+int main(int argc, char const *argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " file.ko file.edits"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ifstream source(argv[1], std::ios::binary);
+    std::ifstream edits(argv[2]);
+    if (!source || !edits) {
+        std::cout << "Cannot read " << (source ? argv[2] : argv[1])
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ostringstream text;
+    text << source.rdbuf();
+    Document document(text.str());
+
+    std::string line;
+    for (int number = 1; std::getline(edits, line); number++) {
+        std::istringstream fields(line);
+        uint64_t offset, removed;
+        if (!(fields >> offset >> removed)) {
+            std::cout << "Malformed edit " << number << ": " << line
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+        fields.get(); // the space before the text
+        std::string inserted;
+        std::getline(fields, inserted);
+
+        EditStats stats;
+        try {
+            stats = document.edit(offset, removed, unescape(inserted));
+        } catch (std::exception &e) {
+            std::cout << "Edit " << number << ": " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Edit " << number << ": " << stats.tokens_relexed
+                  << " tokens relexed, " << stats.tokens_shifted
+                  << " shifted, " << stats.nodes_reparsed
+                  << " nodes reparsed" << (stats.full_parse ? ", full" : "")
+                  << std::endl;
+        if (document.valid()) {
+            AstPrinter().print(document.ast(), std::cout);
+        } else {
+            std::cout << document.error() << std::endl;
+        }
+        if (!document.matches(Document(document.text()))) {
+            std::cout << "Edit " << number << " differs from a full parse"
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,31 @@
+// Embeds libko the way a host program would, for the libko tests. Runs
+// the source file given and prints each diagnostic with its phase and
+// position, then the program's status.
+//
+//   make test/libko/host.out && ./test/libko/host.out file.ko
+
+#include "libko.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+int main(int argc, char const *argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " file.ko" << std::endl;
+        return 1;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    std::ostringstream source;
+    source << in.rdbuf();
+
+    ko::Options options;
+    options.run = true;
+    ko::Result result = ko::compile(source.str(), options);
+    for (const ko::Diagnostic &diagnostic : result.diagnostics) {
+        std::cout << diagnostic.phase << ' ' << diagnostic.line << ':'
+                  << diagnostic.column << ' ' << diagnostic.message
+                  << std::endl;
+    }
+    std::cout << "status " << result.status << std::endl;
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Lexes with each level of scanning kernels and checks that the token
+// streams agree, for the scan tests. The source file given is lexed
+// first, then random sources built from it and from long runs of spaces,
+// digits, letters, comment and string bodies, so the runs cross the 16
+// and 32 byte blocks of the vector kernels at every offset. Levels the
+// CPU does not support fall back to the best one it does.
+//
+//   make test/scan/host.out && ./test/scan/host.out file.ko [cases]
+
+#include "lexer.hpp"
+#include "scan.hpp"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+struct Lexed {
+    TokenStream tokens;
+    std::string errors;
+    bool failed = false;
+};
+
+static Lexed run(std::string_view source, ScanLevel level) {
+    Lexed lexed;
+    Interner interner;
+    std::ostringstream errors;
+    Lexer l;
+    init_lexer(&l, source, interner, errors);
+    l.scan = &scan_kernels(level);
+    try {
+        while (next_token(&l)) {
+            lexed.tokens.push(l.token.type,
+                              l.token.text.data() - source.data(),
+                              l.token.text.size(), l.token.id);
+        }
+    } catch (std::runtime_error &) {
+        lexed.failed = true;
+    }
+    lexed.errors = errors.str();
+    return lexed;
+}
+
+static bool same(const Lexed &a, const Lexed &b) {
+    return a.tokens.types == b.tokens.types &&
+           a.tokens.offsets == b.tokens.offsets &&
+           a.tokens.lengths == b.tokens.lengths &&
+           a.tokens.ids == b.tokens.ids && a.errors == b.errors &&
+           a.failed == b.failed;
+}
+
+static std::string run_of(std::mt19937 &random, const char *chars) {
+    size_t count = std::char_traits<char>::length(chars);
+    std::string out(random() % 80, ' ');
+    for (char &c : out) {
+        c = chars[random() % count];
+    }
+    return out;
+}
+
+static std::string random_source(std::mt19937 &random,
+                                 std::string_view seed) {
+    static const char *const operators[] = {"+", "-", "*", "/", "==",
+                                            "<=", "(", ")", "{", "}"};
+    std::string out;
+    for (size_t pieces = 1 + random() % 40; pieces > 0; pieces--) {
+        switch (random() % 8) {
+        case 0:
+            out += run_of(random, " \t\r\n");
+            break;
+        case 1:
+            out += run_of(random, "0123456789");
+            out += random() % 2 ? "." + run_of(random, "0123456789") : "";
+            break;
+        case 2:
+            out += "x" + run_of(random, "abcXYZ_019");
+            break;
+        case 3:
+            out += "//" + run_of(random, "a \"/\t") + "\n";
+            break;
+        case 4:
+            out += "\"" + run_of(random, "a \n/\t") + "\"";
+            break;
+        case 5:
+            out += operators[random() % 10];
+            break;
+        case 6: {
+            size_t start = seed.empty() ? 0 : random() % seed.size();
+            out += seed.substr(start, random() % 200);
+            break;
+        }
+        default:
+            // Now and then something the lexer rejects
+            out += random() % 10 == 0 ? "$" : " ";
+        }
+    }
+    return out;
+}
+
+int main(int argc, char const *argv[]) {
+    if (argc != 2 && argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " file.ko [cases]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ostringstream seed;
+    seed << in.rdbuf();
+    int cases = argc > 2 ? std::stoi(argv[2]) : 500;
+
+    std::mt19937 random(1);
+    int mismatches = 0;
+    for (int i = 0; i <= cases; i++) {
+        std::string source =
+            i == 0 ? seed.str() : random_source(random, seed.str());
+        Lexed scalar = run(source, SCAN_SCALAR);
+        for (ScanLevel level : {SCAN_SSE2, SCAN_AVX2}) {
+            if (!same(scalar, run(source, level))) {
+                std::cerr << "mismatch with " << scan_kernels(level).name
+                          << " on:\n"
+                          << source << std::endl;
+                mismatches++;
+            }
+        }
+    }
+    if (mismatches > 0) {
+        std::cerr << mismatches << " mismatches" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << cases + 1
+              << " sources lex the same with the scalar, sse2 and avx2 kernels"
+              << std::endl;
+    return 0;
+}
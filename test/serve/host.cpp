@@ -0,0 +1,141 @@
+// Sends requests to a running run.out --serve over one connection, for the
+// server tests, and prints each response. The source file is sent inline
+// and by path, next to a source that fails to parse and a --jit request
+// the server refuses. The first two requests go out in one write and the
+// third one byte at a time, so responses must be framed apart.
+//
+//   ./run.out --serve /tmp/ko.sock &
+//   make test/serve/host.out
+//   ./test/serve/host.out /tmp/ko.sock file.ko
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static void append_u32(std::string &out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out += char(value >> (8 * i));
+    }
+}
+
+static uint32_t load_u32(const char *bytes) {
+    const unsigned char *b = reinterpret_cast<const unsigned char *>(bytes);
+    return b[0] | b[1] << 8 | b[2] << 16 | uint32_t(b[3]) << 24;
+}
+
+static void read_exact(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = read(fd, data, size);
+        if (n <= 0) {
+            throw std::runtime_error("connection closed");
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+static void write_all(int fd, const std::string &bytes) {
+    if (write(fd, bytes.data(), bytes.size()) != ssize_t(bytes.size())) {
+        throw std::runtime_error("short write");
+    }
+}
+
+// The server may still be starting, so connecting is retried for a while
+static int connect_to(const char *path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    for (int attempt = 0; attempt < 500; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, reinterpret_cast<sockaddr *>(&address),
+                    sizeof(address)) == 0) {
+            return fd;
+        }
+        close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    throw std::runtime_error(std::string("cannot connect to ") + path);
+}
+
+// A framed request of arguments and an optional source text
+static std::string request(const std::vector<std::string> &args,
+                           const std::string &source) {
+    std::string payload;
+    for (const std::string &arg : args) {
+        payload += arg + '\0';
+    }
+    payload += '\0';
+    payload += source;
+    std::string framed;
+    append_u32(framed, payload.size());
+    return framed + payload;
+}
+
+// Text with a newline at its end
+static std::string ended(std::string text) {
+    if (text.empty() || text.back() != '\n') {
+        text += '\n';
+    }
+    return text;
+}
+
+// Reads one response and prints its status, out and err
+static void print_response(int fd, const char *name) {
+    char header[4];
+    read_exact(fd, header, 4);
+    uint32_t size = load_u32(header);
+    if (size < 8) {
+        throw std::runtime_error("response frame too short");
+    }
+    std::string response(size, '\0');
+    read_exact(fd, &response[0], size);
+    int32_t status = int32_t(load_u32(&response[0]));
+    uint32_t out_size = load_u32(&response[4]);
+    if (out_size > size - 8) {
+        throw std::runtime_error("out runs past the response frame");
+    }
+    std::cout << name << ": status " << status << '\n'
+              << "out: " << ended(response.substr(8, out_size))
+              << "err: " << ended(response.substr(8 + out_size));
+}
+
+int main(int argc, char const *argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " socket file.ko" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ifstream in(argv[2], std::ios::binary);
+    std::ostringstream source;
+    source << in.rdbuf();
+
+    try {
+        int fd = connect_to(argv[1]);
+        write_all(fd, request({"--print=parser", "--no-assembly"},
+                              source.str()) +
+                          request({argv[2], "--run", "--fold-stats"}, ""));
+        print_response(fd, "inline");
+        print_response(fd, "path");
+
+        for (char c : request({"--run"}, "(1 +")) {
+            write_all(fd, std::string(1, c));
+        }
+        print_response(fd, "parse error");
+
+        write_all(fd, request({"--jit"}, source.str()));
+        print_response(fd, "jit");
+        close(fd);
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -54,8 +54,62 @@ for test_dir in $test_dirs; do
         TOTAL_ATTEMPTED=$((TOTAL_ATTEMPTED + 1))
         
         # Run parser and capture output
-        if [[ "$test_dir" == *"parser"* ]]; then
+        if [[ "$test_dir" == *"/asm_writer" ]]; then
+            # Sections written in turn through small buffers by a host program
+            run_cmd="./test/asm_writer/host.out \"$test_file\""
+        elif [[ "$test_dir" == *"/document" ]]; then
+            # The edits listed next to the test, replayed by a host program
+            run_cmd="./test/document/host.out \"$test_file\" \"${test_file%.ko}.edits\""
+        elif [[ "$test_dir" == *"/cache" ]]; then
+            # A miss, a hit, a second entry that evicts the first, and a miss
+            # for the evicted entry, all in a fresh cache. The first entry is
+            # dated back before the second is stored, so it is the older one
+            # even on a coarse clock.
+            cache="--cache-dir=\$dir --cache-stats"
+            run_cmd="dir=\$(mktemp -d) && ./run.out \"$test_file\" $cache >/dev/null && ./run.out \"$test_file\" $cache >/dev/null && touch -d @1 \$dir/??/* && ./run.out \"$test_file\" --target=x86_64-linux $cache --cache-size=300 >/dev/null && ./run.out \"$test_file\" $cache >/dev/null; status=\$?; rm -rf \$dir; exit \$status"
+        elif [[ "$test_dir" == *"/profile" ]]; then
+            # The phase rows of --time-phases, then the events of the
+            # --trace file, which must parse as JSON
+            trace="\$dir/trace.json"
+            names="import json, sys; print(' '.join(event['name'] for event in json.load(open(sys.argv[1]))['traceEvents']))"
+            run_cmd="dir=\$(mktemp -d) && ./run.out \"$test_file\" --no-fold --run --time-phases --trace=$trace 2>&1 >/dev/null | awk '{print \$1}' && python3 -c \"$names\" $trace; status=\$?; rm -rf \$dir; exit \$status"
+        elif [[ "$test_dir" == *"/lex_chunks" ]]; then
+            # lex_parallel() against lex() on random sources, the check of
+            # bench/lex_bench.cpp. The .ko file only names the test.
+            run_cmd="./test/lex_chunks/host.out 0 300"
+        elif [[ "$test_dir" == *"/libko" ]]; then
+            # Run through the library by a host program linked to libko.a
+            run_cmd="./test/libko/host.out \"$test_file\""
+        elif [[ "$test_dir" == *"/scan" ]]; then
+            # The source and random ones around it, lexed with every level
+            # of scanning kernels by a host program
+            run_cmd="./test/scan/host.out \"$test_file\""
+        elif [[ "$test_dir" == *"/serve" ]]; then
+            # Requests from a host program to a server on a fresh socket,
+            # which has to stop cleanly on SIGTERM afterwards
+            socket="\$dir/ko.sock"
+            run_cmd="dir=\$(mktemp -d) && { ./run.out --serve $socket -j 2 & server=\$!; } && ./test/serve/host.out $socket \"$test_file\"; status=\$?; kill \$server; wait \$server || status=1; rm -rf \$dir; exit \$status"
+        elif [[ "$test_dir" == *"/units" ]]; then
+            # The units listed next to the test, compiled on two threads
+            run_cmd="./run.out -j 2 --print=parser --no-assembly @\"${test_file%.ko}.list\"; echo \$?"
+        elif [[ "$test_dir" == *"parallel_lexer"* ]]; then
+            run_cmd="./run.out \"$test_file\" --lex-threads=4 --print=parser --no-assembly; echo \$?"
+        elif [[ "$test_dir" == *"parser"* ]]; then
             run_cmd="./run.out \"$test_file\" --print=parser --no-assembly"
+        elif [[ "$test_dir" == *"x86_64"* ]]; then
+            run_cmd="./run.out \"$test_file\" --no-fold --target=x86_64-linux"
+        elif [[ "$test_dir" == *"bytecode"* ]]; then
+            run_cmd="./run.out \"$test_file\" --no-fold --print=bytecode --no-assembly"
+        elif [[ "$test_dir" == *"vm"* ]]; then
+            run_cmd="./run.out \"$test_file\" --no-fold --run; echo \$?"
+        elif [[ "$test_dir" == *"jit"* ]]; then
+            run_cmd="./run.out \"$test_file\" --no-fold --jit; echo \$?"
+        elif [[ "$test_dir" == *"asm"* ]]; then
+            run_cmd="./run.out \"$test_file\" --no-fold"
+        elif [[ "$test_dir" == *"/ir" ]]; then
+            run_cmd="./run.out \"$test_file\" --print=ir --no-assembly"
+        elif [[ "$test_dir" == *"fold"* ]]; then
+            run_cmd="./run.out \"$test_file\" --print=folded --no-assembly"
         else
             run_cmd="./run.out \"$test_file\""
         fi